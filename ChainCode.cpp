@@ -0,0 +1,185 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "ChainCode.h"
+
+// Moves of the Freeman codes
+static const int codeR[8] = {0, -1, -1, -1,  0,  1, 1, 1};
+static const int codeC[8] = {1,  1,  0, -1, -1, -1, 0, 1};
+
+// Code of a move (dr, dc) at index (dr+1)*3 + (dc+1). -1 if it is not a move to an 8-neighbor
+static const int moveCodes[9] = {3, 2, 1, 4, -1, 0, 5, 6, 7};
+
+ChainMap::ChainMap(){
+  width = height = 0;
+  noSegments = 0;
+
+  starts = NULL;
+  bitOffsets = NULL;
+  jumpOffsets = NULL;
+  maxSegments = 0;
+
+  codes = NULL;
+  maxCodeBytes = 0;
+
+  jumps = NULL;
+  maxJumps = 0;
+} //end-ChainMap
+
+ChainMap::~ChainMap(){
+  delete[] starts;
+  delete[] bitOffsets;
+  delete[] jumpOffsets;
+  delete[] codes;
+  delete[] jumps;
+} //end-~ChainMap
+
+///-------------------------------------------------------------------------------
+/// Chain code the segments of "map". The codes are sized up front, the jumps are grown as they come
+///
+void ChainMap::Encode(EdgeMap *map){
+  width = map->width;
+  height = map->height;
+
+  int noPixels = 0;
+  for (int i=0; i<map->noSegments; i++) noPixels += map->segments[i].noPixels;
+
+  if (map->noSegments+1 > maxSegments){
+    delete[] starts;
+    delete[] bitOffsets;
+    delete[] jumpOffsets;
+
+    maxSegments = map->noSegments+1;
+    starts = new int[maxSegments];
+    bitOffsets = new int[maxSegments];
+    jumpOffsets = new int[maxSegments];
+  } //end-if
+
+  // One extra byte so that a code can always be read as two bytes
+  int codeBytes = (3*noPixels + 7)/8 + 1;
+  if (codeBytes > maxCodeBytes){
+    delete[] codes;
+    maxCodeBytes = codeBytes;
+    codes = new unsigned char[maxCodeBytes];
+  } //end-if
+
+  memset(codes, 0, codeBytes);
+
+  noSegments = map->noSegments;
+  int bit = 0;
+  int noJumps = 0;
+
+  for (int i=0; i<map->noSegments; i++){
+    Pixel *pixels = map->segments[i].pixels;
+    int n = map->segments[i].noPixels;
+
+    bitOffsets[i] = bit;
+    jumpOffsets[i] = noJumps;
+    starts[i] = n > 0 ? pixels[0].r*width + pixels[0].c : 0;
+
+    // The code of the first pixel is unused
+    bit += 3;
+
+    for (int k=1; k<n; k++, bit+=3){
+      int dr = pixels[k].r - pixels[k-1].r;
+      int dc = pixels[k].c - pixels[k-1].c;
+
+      int code = -1;
+      if (dr >= -1 && dr <= 1 && dc >= -1 && dc <= 1) code = moveCodes[(dr+1)*3 + dc+1];
+
+      if (code < 0){
+        if (noJumps == maxJumps){
+          int newMax = maxJumps ? 2*maxJumps : 256;
+          ChainJump *newJumps = new ChainJump[newMax];
+          if (noJumps) memcpy(newJumps, jumps, sizeof(ChainJump)*noJumps);
+          delete[] jumps;
+          jumps = newJumps;
+          maxJumps = newMax;
+        } //end-if
+
+        jumps[noJumps].index = k;
+        jumps[noJumps].pixel = pixels[k].r*width + pixels[k].c;
+        noJumps++;
+
+        continue;
+      } //end-if
+
+      codes[bit>>3] |= (unsigned char)(code << (bit & 7));
+      if ((bit & 7) > 5) codes[(bit>>3)+1] |= (unsigned char)(code >> (8 - (bit & 7)));
+    } //end-for
+
+    if (n == 0) bit -= 3;
+  } //end-for
+
+  bitOffsets[noSegments] = bit;
+  jumpOffsets[noSegments] = noJumps;
+} //end-Encode
+
+///-------------------------------------------------------------------------------
+/// Decode a whole segment
+///
+void ChainMap::Decode(int i, Pixel *pixels){
+  ChainCursor cursor(this, i);
+
+  int k = 0;
+  while (cursor.Next(&pixels[k])) k++;
+} //end-Decode
+
+ChainCursor::ChainCursor(const ChainMap *map, int i){
+  this->map = map;
+  nextJump = map->jumps + map->jumpOffsets[i];
+  lastJump = map->jumps + map->jumpOffsets[i+1];
+  bit = map->bitOffsets[i] + 3;
+  lastBit = map->bitOffsets[i+1];
+  index = 0;
+  r = map->starts[i] / map->width;
+  c = map->starts[i] % map->width;
+} //end-ChainCursor
+
+bool ChainCursor::Next(Pixel *pixel){
+  if (index == 0){
+    if (lastBit == bit-3) return false;
+
+  } else {
+    if (bit >= lastBit) return false;
+
+    if (nextJump < lastJump && nextJump->index == index){
+      r = nextJump->pixel / map->width;
+      c = nextJump->pixel % map->width;
+      nextJump++;
+
+    } else {
+      const unsigned char *p = map->codes + (bit>>3);
+      int code = ((p[0] | (p[1] << 8)) >> (bit & 7)) & 7;
+
+      r += codeR[code];
+      c += codeC[code];
+    } //end-else
+
+    bit += 3;
+  } //end-else
+
+  pixel->r = r;
+  pixel->c = c;
+  index++;
+
+  return true;
+} //end-Next
@@ -0,0 +1,90 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _CHAIN_CODE_H_
+#define _CHAIN_CODE_H_
+
+#include "EdgeMap.h"
+
+// A pixel that is not an 8-neighbor of its predecessor (e.g., across a joined gap)
+struct ChainJump {
+  int index;            // Index of the pixel within its segment
+  int pixel;            // Linear index r*width+c of the pixel
+};
+
+///-------------------------------------------------------------------------------
+/// Edge segments as Freeman chain codes: The first pixel of a segment & a 3 bit move
+/// per pixel (0: right, 1: up-right, ..., 7: down-right, counter clockwise; the code of
+/// the first pixel is unused). The few pixels that do not follow from a move are kept
+/// in a list of jumps. A segment costs 12 bytes (its start, bit & jump offsets) plus ~3 bits
+/// per pixel instead of sizeof(Pixel) bytes per pixel, and each segment can still be decoded on its own.
+/// Encode re-uses the storage of the previous call
+///
+struct ChainMap {
+public:
+  int width, height;
+  int noSegments;
+
+  int *starts;              // Linear index r*width+c of the first pixel of each segment
+  int *bitOffsets;          // noSegments+1: The codes of segment i are bits [bitOffsets[i], bitOffsets[i+1])
+  int *jumpOffsets;         // noSegments+1: The jumps of segment i are [jumpOffsets[i], jumpOffsets[i+1])
+  int maxSegments;
+
+  unsigned char *codes;     // Packed 3 bit codes, LSB first
+  int maxCodeBytes;
+
+  ChainJump *jumps;
+  int maxJumps;
+
+public:
+  ChainMap();
+  ~ChainMap();
+
+  // Chain code the edge segments of "map"
+  void Encode(EdgeMap *map);
+
+  // Decode segment i into "pixels" (SegmentLength(i) pixels)
+  void Decode(int i, Pixel *pixels);
+
+  int SegmentLength(int i){return (bitOffsets[i+1] - bitOffsets[i])/3;}
+
+  // Size of the chain coded segments in bytes
+  int Size(){return (int)sizeof(int)*(3*noSegments+2) + (bitOffsets[noSegments]+7)/8 + jumpOffsets[noSegments]*(int)sizeof(ChainJump);}
+};
+
+///-------------------------------------------------------------------------------
+/// Decodes the pixels of a chain coded segment one at a time
+///
+struct ChainCursor {
+public:
+  const ChainMap *map;
+  const ChainJump *nextJump;    // Next jump of the segment
+  const ChainJump *lastJump;    // End of the jumps of the segment
+  int bit;                      // Bit offset of the code of the next pixel
+  int lastBit;                  // End of the codes of the segment
+  int index;                    // Index of the next pixel
+  int r, c;                     // Current pixel
+
+public:
+  ChainCursor(const ChainMap *map, int i);
+
+  // Move to the next pixel of the segment. Returns false at the end of the segment
+  bool Next(Pixel *pixel);
+};
+
+#endif
@@ -21,9 +21,21 @@
 
 #include <memory.h>
 
+#include "EdgelIndex.h"
+
 enum GradientOperator {PREWITT_OPERATOR=101, SOBEL_OPERATOR=102, SCHARR_OPERATOR=103};
 
-struct Pixel {int r, c;};
+// Pixel coordinates are 16 bit, which halves the memory traffic of the passes over the
+// edge segments. Define PEL_WIDE_PIXELS for images of more than 65535 pixels per side
+#if defined(PEL_WIDE_PIXELS)
+typedef int PixelCoord;
+#define PIXEL_COORD_MAX 0x7fffffff
+#else
+typedef unsigned short PixelCoord;
+#define PIXEL_COORD_MAX 0xffff
+#endif
+
+struct Pixel {PixelCoord r, c;};
 
 struct EdgeSegment {
   Pixel *pixels;       // Pointer to the pixels array
@@ -39,30 +51,101 @@ public:
   Pixel *pixels;            // Edge map in edge segment form
   EdgeSegment *segments;     
   int noSegments;
+
+  int maxPixels;            // # of pixels the "pixels" array can hold
+  int maxSegments;          // # of segments the "segments" array can hold
+  int maxArea;              // # of pixels edgeImg can hold
+
+  EdgelIndex *drawn;        // Blocks of edgeImg drawn by ConvertEdgeSegments2EdgeImg
       
 public:
-  // constructor
-  EdgeMap(int w, int h){
+  // constructor: Pixel & segment storage is sized by Reserve as the edgels are known
+  EdgeMap(int w, int h, int noPixels=0, int noSegs=0){
     width = w;
     height = h;
 
     edgeImg = new unsigned char[width*height];
+    maxArea = width*height;
 
-    pixels = new Pixel[width*height];
-    segments = new EdgeSegment[width*height];
+    pixels = NULL;
+    segments = NULL;
     noSegments = 0;
+
+    maxPixels = maxSegments = 0;
+    Reserve(noPixels, noSegs);
+
+    drawn = NULL;
   } //end-EdgeMap
 
   // Destructor
   ~EdgeMap(){
-    delete edgeImg;
-    delete pixels;
-    delete segments;
+    delete[] edgeImg;
+    delete[] pixels;
+    delete[] segments;
+    delete drawn;
   } //end-~EdgeMap
 
+  // Re-target the edgemap to another resolution. The pixel & segment storage is kept
+  void Resize(int w, int h){
+    if (w*h > maxArea){
+      delete[] edgeImg;
+      edgeImg = new unsigned char[w*h];
+      maxArea = w*h;
+    } //end-if
+
+    width = w;
+    height = h;
+    noSegments = 0;
+
+    delete drawn;
+    drawn = NULL;
+  } //end-Resize
+
+  // Make room for at least "noPixels" pixels and "noSegs" segments. Existing segments are kept
+  void Reserve(int noPixels, int noSegs){
+    if (noPixels > maxPixels){
+      if (noPixels < 2*maxPixels) noPixels = 2*maxPixels;
+
+      Pixel *newPixels = new Pixel[noPixels];
+      if (maxPixels > 0) memcpy(newPixels, pixels, sizeof(Pixel)*maxPixels);
+
+      // Rebase the segments onto the new pixel array
+      for (int i=0; i<noSegments; i++) segments[i].pixels = newPixels + (segments[i].pixels - pixels);
+
+      delete[] pixels;
+      pixels = newPixels;
+      maxPixels = noPixels;
+    } //end-if
 
+    if (noSegs > maxSegments){
+      if (noSegs < 2*maxSegments) noSegs = 2*maxSegments;
+
+      EdgeSegment *newSegments = new EdgeSegment[noSegs];
+      if (noSegments > 0) memcpy(newSegments, segments, sizeof(EdgeSegment)*noSegments);
+
+      delete[] segments;
+      segments = newSegments;
+      maxSegments = noSegs;
+    } //end-if
+  } //end-Reserve
+
+  // Draw the edge segments onto edgeImg. Only the blocks drawn by the previous call are erased,
+  // so edgeImg should not be written elsewhere in between
   void ConvertEdgeSegments2EdgeImg(){
-    memset(edgeImg, 0, width*height);
+    if (drawn == NULL){
+      memset(edgeImg, 0, width*height);
+      drawn = new EdgelIndex(width, height);
+
+    } else {
+      for (int r=0; r<height; r++){
+        for (int b=drawn->NextBlock(r, 0); b>=0; b=drawn->NextBlock(r, b+1)){
+          int len = width - 8*b < 8 ? width - 8*b : 8;
+          memset(edgeImg + r*width + 8*b, 0, len);
+        } //end-for
+      } //end-for
+
+      drawn->Clear();
+    } //end-else
 
     for (int i=0; i<noSegments; i++){
       for (int j=0; j<segments[i].noPixels; j++){
@@ -70,6 +153,7 @@ public:
         int c = segments[i].pixels[j].c;
 
         edgeImg[r*width+c] = 255;
+        drawn->Mark(r, c);
       } //end-for
     } //end-for
   } //end-ConvertEdgeSegments2EdgeImg
@@ -0,0 +1,151 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _EDGEL_INDEX_H_
+#define _EDGEL_INDEX_H_
+
+#include <memory.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+///-------------------------------------------------------------------------------
+/// Sparse index of the edgels of an image: One bit per 8 pixel block of a row, set if
+/// the block may hold an edgel. Stages iterate over the set blocks only, so their cost is
+/// proportional to the # of edgels rather than the image area on sparse edge maps
+///
+struct EdgelIndex {
+public:
+  int width, height;          // Width & height of the image
+  int wordsPerRow;            // # of 64 bit words per row
+  unsigned long long *bits;   // Bit b of row r is set if the pixels [8b, 8b+8) of row r may hold an edgel
+  int maxWords;               // # of words "bits" can hold
+
+public:
+  EdgelIndex(int w, int h){
+    bits = NULL;
+    maxWords = 0;
+    Resize(w, h);
+  } //end-EdgelIndex
+
+  ~EdgelIndex(){
+    delete[] bits;
+  } //end-~EdgelIndex
+
+  // Re-target the index to another resolution. The bits are re-allocated only if they grow
+  void Resize(int w, int h){
+    width = w;
+    height = h;
+
+    wordsPerRow = ((width+7)/8 + 63)/64;
+    if (wordsPerRow*height > maxWords){
+      delete[] bits;
+      maxWords = wordsPerRow*height;
+      bits = new unsigned long long[maxWords];
+    } //end-if
+
+    Clear();
+  } //end-Resize
+
+  void Clear(){
+    memset(bits, 0, sizeof(unsigned long long)*wordsPerRow*height);
+  } //end-Clear
+
+  // Mark the block of pixel (r, c) as holding an edgel
+  void Mark(int r, int c){
+    bits[r*wordsPerRow + (c>>9)] |= 1ULL << ((c>>3) & 63);
+  } //end-Mark
+
+  ///-------------------------------------------------------------------------------
+  /// Build the index of a BW image with "stride" bytes per row in one pass. Returns the # of blocks holding an edgel
+  ///
+  int Build(const unsigned char *img, int stride){
+    int noBlocks = 0;
+    int fullBlocks = width/8;
+
+    for (int r=0; r<height; r++){
+      const unsigned char *row = img + r*stride;
+      unsigned long long *rowBits = bits + r*wordsPerRow;
+
+      for (int w=0; w<wordsPerRow; w++){
+        unsigned long long word = 0;
+        int b0 = w*64;
+        int b1 = b0+64 < fullBlocks ? b0+64 : fullBlocks;
+
+        for (int b=b0; b<b1; b++){
+          unsigned long long block;
+          memcpy(&block, row + 8*b, 8);
+          if (block) word |= 1ULL << (b-b0);
+        } //end-for
+
+        rowBits[w] = word;
+      } //end-for
+
+      // Partial block at the end of the row
+      for (int c=fullBlocks*8; c<width; c++){
+        if (row[c]){Mark(r, c); break;}
+      } //end-for
+
+      for (int w=0; w<wordsPerRow; w++) noBlocks += PopCount(rowBits[w]);
+    } //end-for
+
+    return noBlocks;
+  } //end-Build
+
+  ///-------------------------------------------------------------------------------
+  /// Returns the first block >= b of row r that may hold an edgel, or -1 if there is none
+  ///
+  int NextBlock(int r, int b) const {
+    const unsigned long long *rowBits = bits + r*wordsPerRow;
+
+    int w = b>>6;
+    if (w >= wordsPerRow) return -1;
+
+    unsigned long long word = rowBits[w] & (~0ULL << (b & 63));
+    while (word == 0){
+      if (++w >= wordsPerRow) return -1;
+      word = rowBits[w];
+    } //end-while
+
+    return w*64 + CountTrailingZeros(word);
+  } //end-NextBlock
+
+  static int CountTrailingZeros(unsigned long long x){
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)x)) return (int)index;
+    _BitScanForward(&index, (unsigned long)(x>>32));
+    return (int)index + 32;
+#else
+    return __builtin_ctzll(x);
+#endif
+  } //end-CountTrailingZeros
+
+  static int PopCount(unsigned long long x){
+    int count = 0;
+    while (x){x &= x-1; count++;}
+    return count;
+  } //end-PopCount
+};
+
+#endif
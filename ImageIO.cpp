@@ -0,0 +1,853 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ImageIO.h"
+
+///======================================= PGM loading ===========================================
+///---------------------------------------------------------------------------------
+/// Skip the whitespace & comments of a PGM header. Comments run up to the end of the line
+///
+static const unsigned char *SkipHeaderSpace(const unsigned char *p, const unsigned char *end){
+  while (p < end){
+    if (*p == '#'){
+      while (p < end && *p != '\n' && *p != '\r') p++;
+    } else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '\v' || *p == '\f'){
+      p++;
+    } else break;
+  } //end-while
+
+  return p;
+} //end-SkipHeaderSpace
+
+///---------------------------------------------------------------------------------
+/// Parse a positive integer of a PGM header. Returns the end of it, NULL if there is none
+///
+static const unsigned char *ParseHeaderInt(const unsigned char *p, const unsigned char *end, int *pValue){
+  p = SkipHeaderSpace(p, end);
+  if (p == end || *p < '0' || *p > '9') return NULL;
+
+  int value = 0;
+  while (p < end && *p >= '0' && *p <= '9'){
+    if (value > 100000000) return NULL;
+    value = value*10 + *p++ - '0';
+  } //end-while
+
+  *pValue = value;
+  return p;
+} //end-ParseHeaderInt
+
+///---------------------------------------------------------------------------------
+/// Validate & parse the header of a PGM image in memory. Returns the offset of the pixels,
+/// -1 if the header is invalid (an error message naming "filename" is printed), -2 if the
+/// data ends within the header, e.g., a frame of a stream not read in full yet
+///
+static int ParseHeaderPGM(const char *filename, const unsigned char *data, size_t size, int *pWidth, int *pHeight, int *pMaxValue, bool *pAscii){
+  const unsigned char *end = data + size;
+
+  if (size < 2 && (size == 0 || data[0] == 'P')) return -2;
+  if (data[0] != 'P' || (data[1] != '5' && data[1] != '2')){
+    fprintf(stderr, "The file %s is not in PGM format (P2 or P5).\n", filename);
+    return -1;
+  } //end-if
+
+  // Each field must be separated by whitespace (or a comment). A field that runs up to the end of
+  // the data may go on
+  const unsigned char *p = data + 2;
+  int fields[3];
+  for (int i=0; i<3; i++){
+    const unsigned char *q = SkipHeaderSpace(p, end);
+    if (q == end) return -2;
+
+    if (q == p || (p = ParseHeaderInt(q, end, &fields[i])) == NULL){
+      fprintf(stderr, "Invalid PGM header in %s.\n", filename);
+      return -1;
+    } //end-if
+
+    if (p == end) return -2;
+  } //end-for
+
+  int width = fields[0], height = fields[1], maxValue = fields[2];
+
+  if (width <= 0 || height <= 0 || (long long)width*height > 0x7fffffff){
+    fprintf(stderr, "Invalid image size %dx%d in %s.\n", width, height, filename);
+    return -1;
+  } //end-if
+
+  if (maxValue <= 0 || maxValue > 255){
+    fprintf(stderr, "Unsupported maxval %d in %s (8 bit images only).\n", maxValue, filename);
+    return -1;
+  } //end-if
+
+  // A single whitespace character ends the header
+  if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '\v' && *p != '\f'){
+    fprintf(stderr, "Invalid PGM header in %s.\n", filename);
+    return -1;
+  } //end-if
+
+  *pWidth = width;
+  *pHeight = height;
+  *pMaxValue = maxValue;
+  *pAscii = (data[1] == '2');
+
+  return (int)(p + 1 - data);
+} //end-ParseHeaderPGM
+
+///---------------------------------------------------------------------------------
+/// Tokenize the pixels of a P2 image from pixel *pNoParsed on, which is advanced past the values
+/// parsed. "pixels" may be "text" itself: A value takes at least 2 characters, so pixel i is
+/// written behind the characters parsed so far. A value that runs up to the end of the text is
+/// complete only if "last" (the text may go on otherwise). Returns the # of characters parsed,
+/// -1 if a value is not a number or is larger than maxValue
+///
+static long ParsePixelsP2(const unsigned char *text, size_t size, unsigned char *pixels, int noPixels, int *pNoParsed, int maxValue, bool last){
+  const unsigned char *p = text;
+  const unsigned char *end = text + size;
+
+  int i = *pNoParsed;
+  while (i < noPixels){
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '\v' || *p == '\f')) p++;
+    if (p == end) break;
+    if (*p < '0' || *p > '9') return -1;
+
+    const unsigned char *q = p;
+    int value = 0;
+    while (q < end && *q >= '0' && *q <= '9'){
+      value = value*10 + *q++ - '0';
+      if (value > maxValue) return -1;
+    } //end-while
+
+    if (q == end && !last) break;
+
+    pixels[i++] = (unsigned char)value;
+    p = q;
+  } //end-while
+
+  *pNoParsed = i;
+  return (long)(p - text);
+} //end-ParsePixelsP2
+
+///---------------------------------------------------------------------------------
+/// Read a whole file with a single read into "*pBuffer" (grown to *pMaxBuffer bytes if necessary).
+/// Returns the # of bytes read, -1 on failure
+///
+static long ReadWholeFile(const char *filename, unsigned char **pBuffer, long *pMaxBuffer){
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL){
+    fprintf(stderr, "Error reading the file %s.\n", filename);
+    return -1;
+  } //end-if
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  if (size < 0){
+    fclose(fp);
+    return -1;
+  } //end-if
+
+  if (size > *pMaxBuffer){
+    free(*pBuffer);
+    *pBuffer = (unsigned char *)malloc(size > 0 ? size : 1);
+    *pMaxBuffer = *pBuffer ? size : 0;
+
+    if (*pBuffer == NULL){
+      fprintf(stderr, "Memory allocation failure reading %s.\n", filename);
+      fclose(fp);
+      return -1;
+    } //end-if
+  } //end-if
+
+  long noRead = (long)fread(*pBuffer, 1, size, fp);
+  fclose(fp);
+
+  if (noRead != size){
+    fprintf(stderr, "Error reading the file %s.\n", filename);
+    return -1;
+  } //end-if
+
+  return size;
+} //end-ReadWholeFile
+
+///---------------------------------------------------------------------------------
+/// Parse the pixels of a PGM file in memory in place. Returns the offset of the pixels, -1 on failure
+///
+static int ParseImagePGM(const char *filename, unsigned char *data, size_t size, int *pWidth, int *pHeight){
+  int maxValue;
+  bool ascii;
+
+  int offset = ParseHeaderPGM(filename, data, size, pWidth, pHeight, &maxValue, &ascii);
+  if (offset == -2) fprintf(stderr, "Truncated PGM header in %s.\n", filename);
+  if (offset < 0) return -1;
+
+  int noPixels = (*pWidth)*(*pHeight);
+
+  if (ascii){
+    // Nothing but whitespace may follow the pixels
+    int noParsed = 0;
+    long len = ParsePixelsP2(data + offset, size - offset, data + offset, noPixels, &noParsed, maxValue, true);
+    const unsigned char *p = data + offset + (len < 0 ? 0 : len);
+    while (p < data + size && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '\v' || *p == '\f')) p++;
+
+    if (len < 0 || noParsed < noPixels || p != data + size){
+      fprintf(stderr, "Invalid or truncated P2 image data in %s.\n", filename);
+      return -1;
+    } //end-if
+
+  } else if (size - offset < (size_t)noPixels){
+    // Bytes beyond the pixels (e.g., another image of a multi-image file) are ignored
+    fprintf(stderr, "Truncated P5 image data in %s: %d of %d pixels.\n", filename, (int)(size - offset), noPixels);
+    return -1;
+  } //end-else
+
+  return offset;
+} //end-ParseImagePGM
+
+/******************************************************************************
+* Function: ReadImagePGM
+* Purpose: This function reads in an image in PGM format (P2 or P5). The whole
+* file is read with a single read, the header is validated (comments may appear
+* anywhere in it, maxval must be at most 255) and the pixels are moved to the
+* start of the buffer, which is returned. The buffer is allocated with malloc.
+* Upon failure, this function returns 0, upon sucess it returns 1.
+******************************************************************************/
+int ReadImagePGM(char *filename, char **pBuffer, int *pWidth, int *pHeight){
+  unsigned char *data = NULL;
+  long maxData = 0;
+
+  long size = ReadWholeFile(filename, &data, &maxData);
+  if (size < 0){
+    free(data);
+    return 0;
+  } //end-if
+
+  int offset = ParseImagePGM(filename, data, size, pWidth, pHeight);
+  if (offset < 0){
+    free(data);
+    return 0;
+  } //end-if
+
+  memmove(data, data + offset, (*pWidth)*(*pHeight));
+  *pBuffer = (char *)data;
+
+  return 1;
+} //end-ReadImagePGM
+
+///---------------------------------------------------------------------------------
+/// Read a binary PBM image (P4): The header is validated as by ReadImagePGM & the packed rows
+/// are moved to the start of the buffer, which is returned (see ImageIO.h). Returns 0 on failure
+///
+int ReadImagePBM(char *filename, char **pBuffer, int *pWidth, int *pHeight){
+  unsigned char *data = NULL;
+  long maxData = 0;
+
+  long size = ReadWholeFile(filename, &data, &maxData);
+  if (size < 0){
+    free(data);
+    return 0;
+  } //end-if
+
+  if (size < 3 || data[0] != 'P' || data[1] != '4'){
+    fprintf(stderr, "The file %s is not in binary PBM format (P4).\n", filename);
+    free(data);
+    return 0;
+  } //end-if
+
+  const unsigned char *end = data + size;
+  const unsigned char *p = data + 2;
+  int width = 0, height = 0;
+
+  // The fields are separated by whitespace (or a comment) & a single whitespace character ends the header
+  if (SkipHeaderSpace(p, end) == p ||
+      (p = ParseHeaderInt(p, end, &width)) == NULL || SkipHeaderSpace(p, end) == p ||
+      (p = ParseHeaderInt(p, end, &height)) == NULL ||
+      p == end || (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '\v' && *p != '\f')){
+    fprintf(stderr, "Invalid PBM header in %s.\n", filename);
+    free(data);
+    return 0;
+  } //end-if
+
+  if (width <= 0 || height <= 0 || (long long)width*height > 0x7fffffff){
+    fprintf(stderr, "Invalid image size %dx%d in %s.\n", width, height, filename);
+    free(data);
+    return 0;
+  } //end-if
+
+  p++;
+  long noBytes = (long)((width+7)/8)*height;
+  if (end - p < noBytes){
+    fprintf(stderr, "Truncated P4 image data in %s: %ld of %ld bytes.\n", filename, (long)(end - p), noBytes);
+    free(data);
+    return 0;
+  } //end-if
+
+  memmove(data, p, noBytes);
+  *pBuffer = (char *)data;
+  *pWidth = width;
+  *pHeight = height;
+
+  return 1;
+} //end-ReadImagePBM
+
+///---------------------------------------------------------------------------------
+/// Save a buffer as a .pgm image. Returns 0 on failure
+///
+int SaveImagePGM(char *filename, char *buffer, int width, int height){
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL){
+    fprintf(stderr, "Error writing the file %s in SaveImagePGM().\n", filename);
+    return 0;
+  } //end-if
+
+  // .PGM header
+  fprintf(fp, "P5\n");
+  fprintf(fp, "# Some comment here!\n");
+  fprintf(fp, "%d %d\n", width, height);
+  fprintf(fp, "255\n");
+
+  // Grayscale image
+  fwrite(buffer, 1, width*height, fp);
+
+  fclose( fp );
+  return 1;
+} //end-SaveImagePGM
+
+///======================================= Frame sequences =======================================
+///---------------------------------------------------------------------------------
+/// Make at least "noBytes" unparsed bytes of a PGM stream available in its buffer, fewer at the
+/// end of the stream. No more is read, so a live stream is not waited on past the current frame.
+/// Returns the # of unparsed bytes
+///
+static long FillStream(FrameSource *source, long noBytes){
+  long noAvailable = source->dataEnd - source->dataStart;
+  if (noAvailable >= noBytes || source->atEOF) return noAvailable;
+
+  // Move the unparsed bytes to the front & grow the buffer if necessary
+  if (noAvailable > 0) memmove(source->data, source->data + source->dataStart, noAvailable);
+  source->dataStart = 0;
+  source->dataEnd = noAvailable;
+
+  if (noBytes > source->maxData){
+    long maxData = noBytes > 2*source->maxData ? noBytes : 2*source->maxData;
+    unsigned char *data = (unsigned char *)realloc(source->data, maxData);
+    if (data == NULL) return noAvailable;
+
+    source->data = data;
+    source->maxData = maxData;
+  } //end-if
+
+  while (source->dataEnd < noBytes){
+    size_t noRead = fread(source->data + source->dataEnd, 1, noBytes - source->dataEnd, source->fp);
+    if (noRead == 0){
+      source->atEOF = true;
+      break;
+    } //end-if
+
+    source->dataEnd += (long)noRead;
+  } //end-while
+
+  return source->dataEnd - source->dataStart;
+} //end-FillStream
+
+///---------------------------------------------------------------------------------
+/// Parse the header of the next PGM frame of a stream with ParseHeaderPGM, reading it a byte at a
+/// time. The header is left unparsed. Returns its length, 0 at the end of the stream, -1 on error
+///
+static int ReadStreamHeader(FrameSource *source, int *pWidth, int *pHeight, int *pMaxValue, bool *pAscii){
+  // Skip the whitespace between frames
+  while (FillStream(source, 1) > 0){
+    unsigned char ch = source->data[source->dataStart];
+    if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n' && ch != '\v' && ch != '\f') break;
+    source->dataStart++;
+  } //end-while
+
+  if (source->dataEnd == source->dataStart) return 0;
+
+  long noBytes = 1;
+  while (1){
+    long noAvailable = FillStream(source, noBytes);
+    int offset = ParseHeaderPGM(source->path, source->data + source->dataStart, noAvailable, pWidth, pHeight, pMaxValue, pAscii);
+    if (offset != -2) return offset;
+
+    if (noAvailable < noBytes){
+      fprintf(stderr, "Truncated PGM header in %s.\n", source->path);
+      return -1;
+    } //end-if
+
+    noBytes = noAvailable+1;
+  } //end-while
+} //end-ReadStreamHeader
+
+///---------------------------------------------------------------------------------
+/// Read the next PGM frame of a stream. Returns 1 on success, 0 at the end of the stream, -1 on error
+///
+static int ReadStreamFrame(FrameSource *source, unsigned char *buffer){
+  int width, height, maxValue;
+  bool ascii;
+
+  int offset = ReadStreamHeader(source, &width, &height, &maxValue, &ascii);
+  if (offset <= 0) return offset;
+  if (width != source->width || height != source->height) return -1;
+
+  source->dataStart += offset;
+  int noPixels = width*height;
+
+  if (!ascii){
+    // The header was read a byte at a time, so the pixels are read straight into the frame
+    long noBuffered = source->dataEnd - source->dataStart;
+    if (noBuffered > noPixels) noBuffered = noPixels;
+
+    memcpy(buffer, source->data + source->dataStart, noBuffered);
+    source->dataStart += noBuffered;
+
+    if ((long)fread(buffer + noBuffered, 1, noPixels - noBuffered, source->fp) != noPixels - noBuffered){
+      fprintf(stderr, "Truncated P5 image data in %s.\n", source->path);
+      return -1;
+    } //end-if
+
+    return 1;
+  } //end-if
+
+  // Each value left takes a digit & a separator at least: Read as many bytes, and one more if
+  // only the end of a value is missing
+  int noParsed = 0;
+  while (noParsed < noPixels){
+    long noAvailable = source->dataEnd - source->dataStart;
+    long noNeeded = 2*(long)(noPixels - noParsed);
+    noAvailable = FillStream(source, noNeeded > noAvailable ? noNeeded : noAvailable+1);
+
+    long len = ParsePixelsP2(source->data + source->dataStart, noAvailable, buffer, noPixels, &noParsed, maxValue, source->atEOF);
+    if (len < 0 || (noParsed < noPixels && source->atEOF)){
+      fprintf(stderr, "Invalid or truncated P2 image data in %s.\n", source->path);
+      return -1;
+    } //end-if
+
+    source->dataStart += len;
+  } //end-while
+
+  return 1;
+} //end-ReadStreamFrame
+
+// Append "dir/name" (or "name" if dir is NULL) to a growing list of files
+static void AddFile(char ***pFiles, int *pNoFiles, int *pMaxFiles, const char *dir, const char *name){
+  if (*pNoFiles == *pMaxFiles){
+    *pMaxFiles = *pMaxFiles ? 2*(*pMaxFiles) : 64;
+    char **grown = new char *[*pMaxFiles];
+    if (*pNoFiles) memcpy(grown, *pFiles, (*pNoFiles)*sizeof(char *));
+    delete[] *pFiles;
+    *pFiles = grown;
+  } //end-if
+
+  char *file = new char[(dir ? strlen(dir)+1 : 0) + strlen(name) + 1];
+  if (dir) sprintf(file, "%s/%s", dir, name);
+  else     strcpy(file, name);
+
+  (*pFiles)[(*pNoFiles)++] = file;
+} //end-AddFile
+
+static bool HasExtensionPGM(const char *name){
+  int len = (int)strlen(name);
+  if (len < 4 || name[len-4] != '.') return false;
+
+  const char *ext = name + len - 3;
+  return (ext[0] == 'p' || ext[0] == 'P') && (ext[1] == 'g' || ext[1] == 'G') && (ext[2] == 'm' || ext[2] == 'M');
+} //end-HasExtensionPGM
+
+static int CompareNames(const void *a, const void *b){
+  return strcmp(*(const char **)a, *(const char **)b);
+} //end-CompareNames
+
+///---------------------------------------------------------------------------------
+/// Lists the .pgm files of a directory sorted by name. Returns the # of files, -1 on error
+///
+static int ListFilesPGM(const char *dirname, char ***pFiles){
+  char **files = NULL;
+  int noFiles = 0;
+  int maxFiles = 0;
+
+#if defined(_WIN32)
+  char *pattern = new char[strlen(dirname)+3];
+  sprintf(pattern, "%s\\*", dirname);
+
+  WIN32_FIND_DATAA entry;
+  HANDLE handle = FindFirstFileA(pattern, &entry);
+  delete[] pattern;
+  if (handle == INVALID_HANDLE_VALUE) return -1;
+
+  do {
+    const char *name = entry.cFileName;
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+#else
+  DIR *dp = opendir(dirname);
+  if (dp == NULL) return -1;
+
+  struct dirent *entry;
+  while ((entry = readdir(dp)) != NULL){
+    const char *name = entry->d_name;
+#endif
+    if (HasExtensionPGM(name)) AddFile(&files, &noFiles, &maxFiles, NULL, name);
+#if defined(_WIN32)
+  } while (FindNextFileA(handle, &entry));
+  FindClose(handle);
+#else
+  } //end-while
+  closedir(dp);
+#endif
+
+  if (noFiles > 1) qsort(files, noFiles, sizeof(char *), CompareNames);
+
+  *pFiles = files;
+  return noFiles;
+} //end-ListFilesPGM
+
+///---------------------------------------------------------------------------------
+/// Lists the input images of a batch. A directory gives the paths of its .pgm files
+///
+int ListInputFiles(const char *name, char ***pFiles){
+  char **names;
+  int noNames = ListFilesPGM(name, &names);
+
+  char **files = NULL;
+  int noFiles = 0, maxFiles = 0;
+
+  if (noNames >= 0){
+    // Directory
+    for (int i=0; i<noNames; i++) AddFile(&files, &noFiles, &maxFiles, name, names[i]);
+    FreeFileList(names, noNames);
+
+  } else {
+    // List file: One path per line
+    FILE *fp = fopen(name, "r");
+    if (fp == NULL){
+      fprintf(stderr, "Error opening the input list %s\n", name);
+      return -1;
+    } //end-if
+
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)){
+      int len = (int)strlen(line);
+      while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t')) line[--len] = 0;
+      if (len == 0 || line[0] == '#') continue;
+
+      AddFile(&files, &noFiles, &maxFiles, NULL, line);
+    } //end-while
+
+    fclose(fp);
+  } //end-else
+
+  *pFiles = files;
+  return noFiles;
+} //end-ListInputFiles
+
+void FreeFileList(char **files, int noFiles){
+  for (int i=0; i<noFiles; i++) delete[] files[i];
+  delete[] files;
+} //end-FreeFileList
+
+FrameSource::FrameSource(){
+  width = height = 0;
+  noFrames = 0;
+
+  fp = NULL;
+  ownsFile = false;
+  raw = false;
+
+  data = NULL;
+  maxData = 0;
+  dataStart = dataEnd = 0;
+  atEOF = false;
+
+  dir = NULL;
+  files = NULL;
+  noFiles = 0;
+  path = NULL;
+} //end-FrameSource
+
+FrameSource::~FrameSource(){
+  if (fp && ownsFile) fclose(fp);
+
+  free(data);
+  FreeFileList(files, noFiles);
+  delete[] dir;
+  delete[] path;
+} //end-~FrameSource
+
+///---------------------------------------------------------------------------------
+/// Open a stream of frames. The size of a PGM stream is that of its first frame, whose header is
+/// parsed but left in the stream buffer for Next()
+///
+bool FrameSource::OpenStream(const char *filename, int rawWidth, int rawHeight){
+  if (filename == NULL || strcmp(filename, "-") == 0){
+    fp = stdin;
+    ownsFile = false;
+    filename = "<stdin>";
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+  } else {
+    fp = fopen(filename, "rb");
+    if (fp == NULL){
+      fprintf(stderr, "Error opening the frame stream %s\n", filename);
+      return false;
+    } //end-if
+
+    ownsFile = true;
+  } //end-else
+
+  path = new char[strlen(filename)+1];
+  strcpy(path, filename);
+
+  if (rawWidth > 0 && rawHeight > 0){
+    raw = true;
+    width = rawWidth;
+    height = rawHeight;
+    return true;
+  } //end-if
+
+  int maxValue;
+  bool ascii;
+  if (ReadStreamHeader(this, &width, &height, &maxValue, &ascii) <= 0){
+    fprintf(stderr, "The frame stream %s is not in PGM format\n", path);
+    return false;
+  } //end-if
+
+  return true;
+} //end-OpenStream
+
+///---------------------------------------------------------------------------------
+/// Open the .pgm files of a directory. The size of the sequence is that of its first frame
+///
+bool FrameSource::OpenDirectory(const char *dirname){
+  noFiles = ListFilesPGM(dirname, &files);
+  if (noFiles < 0){
+    noFiles = 0;
+    fprintf(stderr, "Error listing the directory %s\n", dirname);
+    return false;
+  } //end-if
+
+  if (noFiles == 0){
+    fprintf(stderr, "No .pgm frames in the directory %s\n", dirname);
+    return false;
+  } //end-if
+
+  dir = new char[strlen(dirname)+1];
+  strcpy(dir, dirname);
+
+  int maxName = 0;
+  for (int i=0; i<noFiles; i++){
+    int len = (int)strlen(files[i]);
+    if (len > maxName) maxName = len;
+  } //end-for
+
+  path = new char[strlen(dir) + maxName + 2];
+
+  // Get the frame size from the first frame
+  sprintf(path, "%s/%s", dir, files[0]);
+  long size = ReadWholeFile(path, &data, &maxData);
+  if (size < 0) return false;
+
+  int maxValue;
+  bool ascii;
+  if (ParseHeaderPGM(path, data, size, &width, &height, &maxValue, &ascii) < 0){
+    fprintf(stderr, "The frame %s is not in PGM format\n", path);
+    return false;
+  } //end-if
+
+  return true;
+} //end-OpenDirectory
+
+///---------------------------------------------------------------------------------
+/// Read the next frame of the sequence into "buffer"
+///
+int FrameSource::Next(unsigned char *buffer){
+  if (dir){
+    // Directory: one frame per file, read & parsed as by ReadImagePGM
+    if (noFrames >= noFiles) return 0;
+
+    sprintf(path, "%s/%s", dir, files[noFrames]);
+    long size = ReadWholeFile(path, &data, &maxData);
+    if (size < 0) return -1;
+
+    int w, h;
+    int offset = ParseImagePGM(path, data, size, &w, &h);
+    if (offset < 0 || w != width || h != height) return -1;
+
+    memcpy(buffer, data + offset, width*height);
+
+  } else if (raw){
+    // Raw stream: width*height bytes per frame
+    int noRead = (int)fread(buffer, 1, width*height, fp);
+    if (noRead == 0) return 0;
+    if (noRead != width*height) return -1;
+
+  } else {
+    // PGM stream
+    int status = ReadStreamFrame(this, buffer);
+    if (status != 1) return status;
+  } //end-else
+
+  noFrames++;
+  return 1;
+} //end-Next
+
+///======================================= File mapping ==========================================
+///---------------------------------------------------------------------------------
+/// Map a file copy-on-write: Writes go to private pages, never to the file. Returns NULL on failure
+///
+void *MapFile(const char *filename, size_t *pSize, void **pHandle){
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0){
+    CloseHandle(file);
+    return NULL;
+  } //end-if
+
+  HANDLE handle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(file);
+  if (handle == NULL) return NULL;
+
+  void *data = MapViewOfFile(handle, FILE_MAP_COPY, 0, 0, 0);
+  if (data == NULL){
+    CloseHandle(handle);
+    return NULL;
+  } //end-if
+
+  *pSize = (size_t)size.QuadPart;
+  *pHandle = handle;
+  return data;
+
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0){
+    close(fd);
+    return NULL;
+  } //end-if
+
+  void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return NULL;
+
+  *pSize = (size_t)st.st_size;
+  *pHandle = NULL;
+  return data;
+#endif
+} //end-MapFile
+
+void UnmapFile(void *data, size_t size, void *handle){
+#if defined(_WIN32)
+  UnmapViewOfFile(data);
+  CloseHandle((HANDLE)handle);
+#else
+  (void)handle;
+  munmap(data, size);
+#endif
+} //end-UnmapFile
+
+///======================================= PGMImage ==============================================
+PGMImage::PGMImage(){
+  width = height = 0;
+  pixels = NULL;
+
+  buffer = NULL;
+  maxBuffer = 0;
+
+  mapping = NULL;
+  mappingSize = 0;
+  mappingHandle = NULL;
+} //end-PGMImage
+
+PGMImage::~PGMImage(){
+  Unload();
+  free(buffer);
+} //end-~PGMImage
+
+void PGMImage::Unload(){
+  if (mapping){
+    UnmapFile(mapping, mappingSize, mappingHandle);
+    mapping = NULL;
+    mappingHandle = NULL;
+    mappingSize = 0;
+  } //end-if
+
+  pixels = NULL;
+} //end-Unload
+
+///---------------------------------------------------------------------------------
+/// Load an image mapping P5 files, reading everything else
+///
+bool PGMImage::Load(const char *filename, bool useMapping){
+  Unload();
+
+  int offset;
+
+  if (useMapping){
+    void *handle;
+    size_t size;
+    unsigned char *data = (unsigned char *)MapFile(filename, &size, &handle);
+
+    // P2 images are tokenized, so they are read
+    if (data && size > 2 && data[1] == '5'){
+      mapping = data;
+      mappingSize = size;
+      mappingHandle = handle;
+
+      offset = ParseImagePGM(filename, data, size, &width, &height);
+      if (offset < 0){
+        Unload();
+        return false;
+      } //end-if
+
+      pixels = data + offset;
+      return true;
+    } //end-if
+
+    if (data) UnmapFile(data, size, handle);
+  } //end-if
+
+  long size = ReadWholeFile(filename, &buffer, &maxBuffer);
+  if (size < 0) return false;
+
+  offset = ParseImagePGM(filename, buffer, size, &width, &height);
+  if (offset < 0) return false;
+
+  pixels = buffer + offset;
+  return true;
+} //end-Load
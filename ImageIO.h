@@ -0,0 +1,113 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _IMAGE_IO_H_
+#define _IMAGE_IO_H_
+
+#include <stdio.h>
+
+/// Two functions to read/save PGM files
+int ReadImagePGM(char *filename, char **pBuffer, int *pWidth, int *pHeight);
+int SaveImagePGM(char *filename, char *buffer, int width, int height);
+
+// Read a binary PBM image (P4) as is: Rows of (width+7)/8 bytes, 8 pixels per byte with the leftmost
+// in the most significant bit, 1 for black. Link it with PELContext::LinkBits. Returns 0 on failure
+int ReadImagePBM(char *filename, char **pBuffer, int *pWidth, int *pHeight);
+
+// Map a whole file copy-on-write: Writes go to private pages, never to the file.
+// Returns NULL on failure (or for an empty file). Release with UnmapFile
+void *MapFile(const char *filename, size_t *pSize, void **pHandle);
+void UnmapFile(void *data, size_t size, void *handle);
+
+///-------------------------------------------------------------------------------
+/// A PGM image loaded for linking. A P5 image is mapped copy-on-write from its file
+/// where the platform allows it, so PEL can modify the pixels in place without a copy
+/// of the file & without touching it. Otherwise the file is read with a single read into
+/// a buffer that is kept for the next Load (P2 pixels are tokenized in place). The
+/// header is validated as by ReadImagePGM
+///
+struct PGMImage {
+public:
+  int width, height;
+  unsigned char *pixels;    // width*height pixels. Valid until the next Load() or Unload()
+
+  unsigned char *buffer;    // Read buffer, re-used across loads
+  long maxBuffer;
+
+  void *mapping;            // Mapped file, NULL if the image was read
+  size_t mappingSize;
+  void *mappingHandle;
+
+public:
+  PGMImage();
+  ~PGMImage();
+
+  // Load an image. useMapping=false always reads the file. Returns false on failure
+  bool Load(const char *filename, bool useMapping=true);
+
+  // Release the mapping of the current image (the read buffer is kept)
+  void Unload();
+};
+
+// Lists the input images given by "name": The .pgm files of a directory sorted by name, or the
+// lines of a list file (empty & # lines are skipped). Returns the # of files, -1 on error
+int ListInputFiles(const char *name, char ***pFiles);
+void FreeFileList(char **files, int noFiles);
+
+///-------------------------------------------------------------------------------
+/// A sequence of same-sized frames: Either a stream of concatenated PGM (P5/P2)
+/// or raw 8 bit frames (e.g., stdin), or the .pgm files of a directory in name
+/// order. The frame size is known once the source is opened, so the caller can
+/// allocate a single frame buffer and re-use it for every frame
+///
+struct FrameSource {
+public:
+  int width, height;   // Size of every frame of the sequence
+  int noFrames;        // # of frames read so far
+
+  FILE *fp;            // Frame stream. NULL for a directory
+  bool ownsFile;       // Close fp when done?
+  bool raw;            // Stream of headerless width*height byte frames?
+
+  unsigned char *data; // Read buffer of a PGM stream, or the current frame file of a directory
+  long maxData;        // # of bytes data can hold
+  long dataStart, dataEnd;  // Bytes of a PGM stream read but not parsed yet
+  bool atEOF;          // Has the stream been read to its end?
+
+  char *dir;           // Directory of the frame files
+  char **files;        // Frame file names, sorted
+  int noFiles;
+  char *path;          // Path of the current frame file, or the name of the stream
+
+public:
+  FrameSource();
+  ~FrameSource();
+
+  // Open a stream of frames. "filename" of "-" or NULL is stdin.
+  // rawWidth & rawHeight > 0 select raw frames of that size. Returns false on failure
+  bool OpenStream(const char *filename, int rawWidth=0, int rawHeight=0);
+
+  // Open the .pgm files of a directory. Returns false on failure or if there are no frames
+  bool OpenDirectory(const char *dirname);
+
+  // Read the next frame into "buffer" of width*height bytes.
+  // Returns 1 on success, 0 at the end of the sequence, -1 on error (e.g., a frame of a different size)
+  int Next(unsigned char *buffer);
+};
+
+#endif
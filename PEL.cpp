@@ -18,41 +18,501 @@
  ******************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "EdgeMap.h"
 #include "PEL.h"
+#include "Timer.h"
 
 // Helper function prototypes
 static void FillGaps1(unsigned char *edgeImg, int width, int height);
-static void FillGaps2(unsigned char *edgeImg, int width, int height);
+static int FillGaps2(unsigned char *edgeImg, int width, int height, int stride, int *noGaps);
+static int FillGaps2SIMD(unsigned char *edgeImg, int width, int height, int stride, int *noGaps);
+static int FillGaps2Sparse(unsigned char *edgeImg, int width, int height, int stride, EdgelIndex *index, int *noGaps);
+static int FillGaps2Const(const unsigned char *edgeImg, int width, int height, int stride, unsigned char *bits, EdgelIndex *index, bool useSIMD, int *noGaps);
+static void PackEdgeMap(const unsigned char *edgeImg, int width, int height, int stride, unsigned long long *edgels, unsigned long long *strong, int wordsPerRow);
+static void PackEdgeBits(const unsigned char *bits, int width, int height, int stride, unsigned long long *edgels, unsigned long long *strong, int wordsPerRow);
+static int FillGaps2Bitmap(const unsigned long long *strong, unsigned long long *edgels, int width, int height, int wordsPerRow, int *noGaps);
 
-EdgeMap *PELWalk8Dirs(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN);
-static void JoinNeighborEdgeSegments(EdgeMap *map);
+///-------------------------------------------------------------------------------
+/// Edgel accessors of the walk: The walk reads the edgels with [] & takes the walked ones
+/// out with Clear(). EdgelImage works on the edge map itself. ConstEdgels leaves a read-only
+/// edge map untouched & keeps its changes in an edgel bitmap of 1 bit per pixel at the same
+/// offsets: A pixel is an edgel if it is nonzero in the edge map XOR its bit is set. So the
+/// bits set by FillGaps2 add the gaps & clearing an edgel sets its bit back to its pixel.
+/// BitEdgels works on a packed bitmap of the edgels alone (see PELContext::useBitmap)
+///
+struct EdgelImage {
+  unsigned char *img;
+
+  int operator[](int o) const {return img[o];}
+  void Clear(int o) const {img[o] = 0;}
+};
+
+struct ConstEdgels {
+  const unsigned char *img;
+  unsigned char *bits;
+
+  int operator[](int o) const {return (img[o] != 0) ^ ((bits[o>>3] >> (o&7)) & 1);}
+  void Clear(int o) const {
+    if (img[o]) bits[o>>3] |= (unsigned char)(1 << (o&7));
+    else        bits[o>>3] &= (unsigned char)~(1 << (o&7));
+  } //end-Clear
+};
+
+struct BitEdgels {
+  unsigned long long *words;    // Bit c%64 of word c/64 of a row is column c
+
+  int operator[](int o) const {return (int)(words[o>>6] >> (o&63)) & 1;}
+  void Clear(int o) const {words[o>>6] &= ~(1ULL << (o&63));}
+};
+
+template <class Edgels> using WalkFunc = int (*)(Edgels edgeImg, int width, int height, int stride, int r, int c, int dir, Pixel *pixels);
+template <class Edgels> static int Walk8Dirs(Edgels edgeImg, int width, int height, int stride, int r, int c, int dir, Pixel *pixels);
+template <class Edgels> static int Walk8DirsTable(Edgels edgeImg, int width, int height, int stride, int r, int c, int dir, Pixel *pixels);
+
+template <class Edgels>
+static void PELWalk8Dirs(Edgels edgeImg, int width, int height, int stride, int MIN_SEGMENT_LEN, EdgeMap *map, Pixel *pixels, const EdgelIndex *index, WalkFunc<Edgels> walk);
+template <class Edgels>
+static void PELWalk8DirsTiled(PELContext *ctx, EdgeMap *map, Edgels edgeImg, int stride, int MIN_SEGMENT_LEN);
+static void DeleteWalkWorkers(WalkWorkers *workers);
+static void ClipEdgeSegments(PELContext *ctx, EdgeMap *map, int maxClipSize=5);
+static void JoinNeighborEdgeSegments(PELContext *ctx, EdgeMap *map);
 static void ThinEdgeSegments(EdgeMap *map, int MIN_SEGMENT_LEN);
 static void FixEdgeSegments(EdgeMap *map);
 
 ///-------------------------------------------------------------------------------
 /// Predictive Edge Linking (PEL)
 ///
-EdgeMap *PEL(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN){
+EdgeMap *PEL(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN, PELStats *stats){
+  PELContext ctx(width, height);
+
+  ctx.Link(edgeImg, MIN_SEGMENT_LEN);
+  if (stats) *stats = ctx.stats;
+
+  return ctx.DetachMap();
+} //end-PEL
+
+EdgeMap *PEL(const unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN, PELStats *stats){
+  PELContext ctx(width, height);
+
+  ctx.Link(edgeImg, MIN_SEGMENT_LEN);
+  if (stats) *stats = ctx.stats;
+
+  return ctx.DetachMap();
+} //end-PEL
+
+EdgeMap *PELBits(const unsigned char *bits, int width, int height, int MIN_SEGMENT_LEN, PELStats *stats){
+  PELContext ctx(width, height);
+
+  ctx.LinkBits(bits, MIN_SEGMENT_LEN);
+  if (stats) *stats = ctx.stats;
+
+  return ctx.DetachMap();
+} //end-PELBits
+
+///-------------------------------------------------------------------------------
+/// PELContext: Allocates the working set for a width x height image
+///
+PELContext::PELContext(int w, int h){
+  width = w;
+  height = h;
+
+  map = NULL;
+  walkPixels = NULL;
+  maxWalkPixels = 0;
+
+  segmentOwners = new int[width*height]();
+  ownerBase = 0;
+  useOwnerIndex = true;
+  endpointCells = NULL;
+  maxEndpointCells = 0;
+  endpoints = NULL;
+  maxEndpoints = 0;
+  useEndpointHash = true;
+
+  joinSegments = NULL;
+  maxJoinSegments = 0;
+
+  neighbors = NULL;
+  listBuffer = NULL;
+  maxSegments = 0;
+
+  useSIMD = true;
+  useEdgelIndex = true;
+  useWalkTable = false;
+  useBitmap = true;
+  index = new EdgelIndex(width, height);
+
+  noThreads = 1;
+  walkWorkers = NULL;
+  tileImg = NULL;
+  maxTileImg = 0;
+  tilePixels = NULL;
+  tileChains = NULL;
+  tileAnchors = NULL;
+  maxTileEdgels = 0;
+  tileOwners = NULL;
+  maxTileOwners = 0;
+
+  maxArea = width*height;
+  regionMap = NULL;
+
+  edgelBits = NULL;
+  maxEdgelBits = 0;
+  bitmap = NULL;
+  maxBitmapWords = 0;
+
+  memset(&stats, 0, sizeof(stats));
+} //end-PELContext
+
+PELContext::~PELContext(){
+  delete map;
+  delete[] walkPixels;
+  delete[] segmentOwners;
+  delete[] endpointCells;
+  delete[] endpoints;
+  delete[] joinSegments;
+  delete[] neighbors;
+  delete[] listBuffer;
+  delete index;
+  DeleteWalkWorkers(walkWorkers);
+  delete[] tileImg;
+  delete[] tilePixels;
+  delete[] tileChains;
+  delete[] tileAnchors;
+  delete[] tileOwners;
+  delete regionMap;
+  delete[] edgelBits;
+  delete[] bitmap;
+} //end-~PELContext
+
+///-------------------------------------------------------------------------------
+/// The per pixel maps are re-allocated only if the new resolution has more pixels than
+/// they can hold, so images of the same area (e.g., landscape & portrait) or regions of
+/// different sizes share them. The buffers sized by the # of edgels are kept as they are
+///
+void PELContext::Resize(int w, int h){
+  if (w == width && h == height) return;
+
+  if (w*h > maxArea){
+    delete[] segmentOwners;
+
+    maxArea = w*h;
+    segmentOwners = new int[maxArea]();
+  } //end-if
+
+  width = w;
+  height = h;
+
+  index->Resize(width, height);
+
+  if (map) map->Resize(width, height);
+} //end-Resize
+
+///-------------------------------------------------------------------------------
+/// Link the edges of "edgeImg" re-using the buffers of the context
+///
+EdgeMap *PELContext::Link(unsigned char *edgeImg, int MIN_SEGMENT_LEN, int stride){
+  if (map == NULL) map = new EdgeMap(width, height);
+
+  LinkWalk(edgeImg, map, stride);
+  LinkJoin(map);
+  LinkFinish(map, MIN_SEGMENT_LEN);
+
+  return map;
+} //end-Link
+
+EdgeMap *PELContext::Link(const unsigned char *edgeImg, int MIN_SEGMENT_LEN, int stride){
+  if (map == NULL) map = new EdgeMap(width, height);
+
+  LinkWalk(edgeImg, map, stride);
+  LinkJoin(map);
+  LinkFinish(map, MIN_SEGMENT_LEN);
+
+  return map;
+} //end-Link
+
+///-------------------------------------------------------------------------------
+/// Link the edges of the bit-packed edge map "bits"
+///
+EdgeMap *PELContext::LinkBits(const unsigned char *bits, int MIN_SEGMENT_LEN, int stride){
+  if (map == NULL) map = new EdgeMap(width, height);
+
+  LinkWalkBits(bits, map, stride);
+  LinkJoin(map);
+  LinkFinish(map, MIN_SEGMENT_LEN);
+
+  return map;
+} //end-LinkBits
+
+///-------------------------------------------------------------------------------
+/// Link each region as a width x height view into the image (no copy), then append its
+/// segments to the region map moved to image coordinates. The context is resized to each
+/// region and back to its own size at the end
+///
+EdgeMap *PELContext::LinkRegions(unsigned char *image, int imageWidth, int imageHeight, int stride,
+                                 const PELRect *regions, int noRegions, int MIN_SEGMENT_LEN){
+  if (regionMap == NULL) regionMap = new EdgeMap(imageWidth, imageHeight);
+  else                   regionMap->Resize(imageWidth, imageHeight);
+
+  int w = width, h = height;
+  int noPixels = 0;
+  for (int k=0; k<noRegions; k++){
+    // Clip the region to the image
+    int x0 = regions[k].x < 0 ? 0 : regions[k].x;
+    int y0 = regions[k].y < 0 ? 0 : regions[k].y;
+    int x1 = regions[k].x + regions[k].width < imageWidth ? regions[k].x + regions[k].width : imageWidth;
+    int y1 = regions[k].y + regions[k].height < imageHeight ? regions[k].y + regions[k].height : imageHeight;
+    if (x1-x0 < 3 || y1-y0 < 3) continue;
+
+    Resize(x1-x0, y1-y0);
+    EdgeMap *map = Link(image + y0*stride + x0, MIN_SEGMENT_LEN, stride);
+    if (map->noSegments == 0) continue;
+
+    int noRegionPixels = 0;
+    for (int i=0; i<map->noSegments; i++) noRegionPixels += map->segments[i].noPixels;
+    regionMap->Reserve(noPixels + noRegionPixels, regionMap->noSegments + map->noSegments);
+
+    for (int i=0; i<map->noSegments; i++){
+      EdgeSegment *segment = &regionMap->segments[regionMap->noSegments++];
+      segment->pixels = regionMap->pixels + noPixels;
+      segment->noPixels = map->segments[i].noPixels;
+
+      for (int j=0; j<segment->noPixels; j++){
+        segment->pixels[j].r = map->segments[i].pixels[j].r + y0;
+        segment->pixels[j].c = map->segments[i].pixels[j].c + x0;
+      } //end-for
+
+      noPixels += segment->noPixels;
+    } //end-for
+  } //end-for
+
+  Resize(w, h);
+  return regionMap;
+} //end-LinkRegions
+
+///-------------------------------------------------------------------------------
+/// The walk stores Pixel coordinates: Returns false if the image does not fit them
+///
+static bool FitsPixelCoords(int width, int height){
+  if (width-1 <= PIXEL_COORD_MAX && height-1 <= PIXEL_COORD_MAX) return true;
+
+  fprintf(stderr, "PEL: %dx%d image exceeds the Pixel coordinates. Build with PEL_WIDE_PIXELS\n", width, height);
+  return false;
+} //end-FitsPixelCoords
+
+///-------------------------------------------------------------------------------
+/// Size the edge segment storage by the # of edgels: The walk stores an edgel at most once
+/// & keeps chains of at least 7 pixels, and the joined segments are placed after the walked ones
+///
+static void ReserveWalk(PELContext *ctx, EdgeMap *map, int noEdgels){
+  map->noSegments = 0;
+  map->Reserve(2*noEdgels+1, noEdgels/7+1);
+
+  if (noEdgels > ctx->maxWalkPixels){
+    delete[] ctx->walkPixels;
+    ctx->maxWalkPixels = map->maxPixels/2;
+    ctx->walkPixels = new Pixel[ctx->maxWalkPixels];
+  } //end-if
+} //end-ReserveWalk
+
+///-------------------------------------------------------------------------------
+/// Stage 1 of Link on the packed bitmaps of "edgeImg" (useBitmap), which is only read.
+/// "edgeImg" is a byte per pixel edge map, or a bit-packed one if "packed" (see LinkBits)
+///
+static void LinkWalkBitmap(PELContext *ctx, const unsigned char *edgeImg, bool packed, EdgeMap *map, int stride){
+  int width = ctx->width;
+  int height = ctx->height;
+  int wordsPerRow = width/64 + 1;     // At least one empty word after each row
+  int noWords = height*wordsPerRow;
+
+  if (2*noWords > ctx->maxBitmapWords){
+    delete[] ctx->bitmap;
+    ctx->maxBitmapWords = 2*noWords;
+    ctx->bitmap = new unsigned long long[ctx->maxBitmapWords];
+  } //end-if
+
+  unsigned long long *edgels = ctx->bitmap;          // Edgels, gaps filled & walked ones cleared
+  unsigned long long *strong = ctx->bitmap + noWords; // Pixels equal to 255
+
+  Timer timer;
+  timer.Start();
+
+  if (packed) PackEdgeBits(edgeImg, width, height, stride, edgels, strong, wordsPerRow);
+  else        PackEdgeMap(edgeImg, width, height, stride, edgels, strong, wordsPerRow);
+
+  int noEdgels = FillGaps2Bitmap(strong, edgels, width, height, wordsPerRow, &ctx->stats.noGapsFilled);
+
+  ctx->stats.noEdgels = noEdgels;
+  ctx->stats.fillGapsTime = timer.Lap();
+
+  ReserveWalk(ctx, map, noEdgels);
+
+  BitEdgels bits = {edgels};
+  if (ctx->noThreads > 1){
+    PELWalk8DirsTiled(ctx, map, bits, 64*wordsPerRow, 7);
+
+  } else {
+    PELWalk8Dirs(bits, width, height, 64*wordsPerRow, 7, map, ctx->walkPixels, NULL,
+                 ctx->useWalkTable ? Walk8DirsTable<BitEdgels> : Walk8Dirs<BitEdgels>);
+  } //end-else
+
+  ctx->stats.noChains = map->noSegments;
+  ctx->stats.walkTime = timer.Lap();
+} //end-LinkWalkBitmap
+
+///-------------------------------------------------------------------------------
+/// Stage 1 of Link: Fill the gaps of "edgeImg" & walk its edges into "map"
+///
+void PELContext::LinkWalk(unsigned char *edgeImg, EdgeMap *map, int stride){
+  if (stride <= 0) stride = width;
+  if (!FitsPixelCoords(width, height)){map->noSegments = 0; return;}
+  if (useBitmap){LinkWalkBitmap(this, edgeImg, false, map, stride); return;}
+
+  Timer timer;
+  timer.Start();
+
   // Close gaps of 1 pixel wide
 //  FillGaps1(edgeImg, width, height);
-  FillGaps2(edgeImg, width, height);
+  // On sparse edge maps visit the blocks of the edgel index only
+  EdgelIndex *walkIndex = NULL;
+  int noEdgels;
+
+  if (useEdgelIndex && index->Build(edgeImg, stride) < height*((width+7)/8)/4){
+    noEdgels = FillGaps2Sparse(edgeImg, width, height, stride, index, &stats.noGapsFilled);
+    walkIndex = index;
+
+  } else if (useSIMD){
+    noEdgels = FillGaps2SIMD(edgeImg, width, height, stride, &stats.noGapsFilled);
+
+  } else {
+    noEdgels = FillGaps2(edgeImg, width, height, stride, &stats.noGapsFilled);
+  } //end-else
+
+  stats.noEdgels = noEdgels;
+  stats.fillGapsTime = timer.Lap();
+
+  ReserveWalk(this, map, noEdgels);
 
   // Convert the filled-up edge map to edge segments using 8 directional predictive edge linking
-  EdgeMap *map = PELWalk8Dirs(edgeImg, width, height, 7); 
+  WalkFunc<EdgelImage> walk = useWalkTable ? Walk8DirsTable<EdgelImage> : Walk8Dirs<EdgelImage>;
+
+  EdgelImage edgels = {edgeImg};
+  if (noThreads > 1) PELWalk8DirsTiled(this, map, edgels, stride, 7);
+  else               PELWalk8Dirs(edgels, width, height, stride, 7, map, walkPixels, walkIndex, walk);
+
+  stats.noChains = map->noSegments;
+  stats.walkTime = timer.Lap();
+} //end-LinkWalk
+
+///-------------------------------------------------------------------------------
+/// Stage 1 of Link on a read-only "edgeImg": The gaps filled & the edgels walked are
+/// kept in the edgel bitmap of the context, which covers the rows of the view
+///
+void PELContext::LinkWalk(const unsigned char *edgeImg, EdgeMap *map, int stride){
+  if (stride <= 0) stride = width;
+  if (!FitsPixelCoords(width, height)){map->noSegments = 0; return;}
+  if (useBitmap){LinkWalkBitmap(this, edgeImg, false, map, stride); return;}
+
+  int noBytes = ((height-1)*stride + width + 7)/8;
+  if (noBytes > maxEdgelBits){
+    delete[] edgelBits;
+    maxEdgelBits = noBytes;
+    edgelBits = new unsigned char[maxEdgelBits];
+  } //end-if
+
+  Timer timer;
+  timer.Start();
+
+  EdgelIndex *walkIndex = NULL;
+  if (useEdgelIndex && index->Build(edgeImg, stride) < height*((width+7)/8)/4) walkIndex = index;
+
+  int noEdgels = FillGaps2Const(edgeImg, width, height, stride, edgelBits, walkIndex, useSIMD, &stats.noGapsFilled);
 
-  // Extend the edge segments
-  JoinNeighborEdgeSegments(map);
+  stats.noEdgels = noEdgels;
+  stats.fillGapsTime = timer.Lap();
+
+  ReserveWalk(this, map, noEdgels);
+
+  ConstEdgels edgels = {edgeImg, edgelBits};
+  if (noThreads > 1){
+    PELWalk8DirsTiled(this, map, edgels, stride, 7);
+
+  } else {
+    PELWalk8Dirs(edgels, width, height, stride, 7, map, walkPixels, walkIndex,
+                 useWalkTable ? Walk8DirsTable<ConstEdgels> : Walk8Dirs<ConstEdgels>);
+  } //end-else
+
+  stats.noChains = map->noSegments;
+  stats.walkTime = timer.Lap();
+} //end-LinkWalk
+
+///-------------------------------------------------------------------------------
+/// Stage 1 of LinkBits: Always on the bitmaps of useBitmap, which are filled from "bits" directly
+///
+void PELContext::LinkWalkBits(const unsigned char *bits, EdgeMap *map, int stride){
+  if (stride <= 0) stride = (width+7)/8;
+  if (!FitsPixelCoords(width, height)){map->noSegments = 0; return;}
+
+  LinkWalkBitmap(this, bits, true, map, stride);
+} //end-LinkWalkBits
+
+///-------------------------------------------------------------------------------
+/// Stage 2 of Link: Extend the edge segments of "map"
+///
+void PELContext::LinkJoin(EdgeMap *map){
+  // The joined segments are swapped with map->segments, so they must hold as many
+  if (map->maxSegments > maxJoinSegments){
+    delete[] joinSegments;
+    maxJoinSegments = map->maxSegments;
+    joinSegments = new EdgeSegment[maxJoinSegments];
+  } //end-if
+
+  Timer timer;
+  timer.Start();
+
+  // Clip the tips of the edge segments
+  ClipEdgeSegments(this, map, 5);
+  stats.clipTime = timer.Lap();
+
+  int noClipped = map->noSegments;
+  JoinNeighborEdgeSegments(this, map);
+
+  stats.noJoins = noClipped - map->noSegments;
+  stats.joinTime = timer.Lap();
+} //end-LinkJoin
+
+///-------------------------------------------------------------------------------
+/// Stage 3 of Link: Thin down the edge segments of "map" & fix their jitters
+///
+void PELContext::LinkFinish(EdgeMap *map, int MIN_SEGMENT_LEN){
+  Timer timer;
+  timer.Start();
 
   // Thin down edge segments
   ThinEdgeSegments(map, MIN_SEGMENT_LEN);
+  stats.thinTime = timer.Lap();
 
   // Fix jitters of 1 pixel within an edge segment
   FixEdgeSegments(map);
+  stats.fixTime = timer.Lap();
 
-  return map;
-} //end-PEL
+  stats.noSegments = map->noSegments;
+} //end-LinkFinish
+
+///-------------------------------------------------------------------------------
+/// The caller becomes the owner of the edgemap. A new one is allocated on the next Link()
+///
+EdgeMap *PELContext::DetachMap(){
+  EdgeMap *detached = map;
+  map = NULL;
+
+  return detached;
+} //end-DetachMap
 
 ///======================================= STEP 1: FillGaps ======================================
 ///------------------------------------------------------------------------
@@ -161,367 +621,947 @@ static void FillGaps1(unsigned char *edgeImg, int width, int height){
 } //end-FillGaps1
 
 ///---------------------------------------------------------------------------------
-/// Close gaps of 1 pixel wide: This joins the tip of an edge group to ANY neighbouring edgel
+/// FillGaps2 for a single edgel at (i, j): If it is the tip of an edge group, returns the index of
+/// the pixel joining it to a neighbouring edgel, -1 if none. Only the pixels equal to 255 are looked
+/// at, so marking the gaps (with anything else) does not change the outcome for the other edgels
 ///
-static void FillGaps2(unsigned char *edgeImg, int width, int height){
-  for (int i=2; i<height-2; i++){
-    for (int j=2; j<width-2; j++){
-      if (edgeImg[i*width+j] != 255) continue;
-
-      int count = 0;
-      int loc = 1;
-      if (edgeImg[(i-1)*width+j] == 255) count++;
-      if (edgeImg[(i+1)*width+j] == 255){count++; loc = 2;}
-      if (edgeImg[i*width+j-1] == 255){count++; loc = 3;}
-      if (edgeImg[i*width+j+1] == 255){count++; loc = 4;}
-
-      if (edgeImg[(i-1)*width+j-1] == 255 && edgeImg[(i-1)*width+j] != 255 && edgeImg[i*width+j-1] != 255){count++; loc = 5;}
-      if (edgeImg[(i-1)*width+j+1] == 255 && edgeImg[(i-1)*width+j] != 255 && edgeImg[i*width+j+1] != 255){count++; loc = 6;}
-      if (edgeImg[(i+1)*width+j+1] == 255 && edgeImg[(i+1)*width+j] != 255 && edgeImg[i*width+j+1] != 255){count++; loc = 7;}
-      if (edgeImg[(i+1)*width+j-1] == 255 && edgeImg[(i+1)*width+j] != 255 && edgeImg[i*width+j-1] != 255){count++; loc = 8;}
-
-      if (count == 0 || count > 1) continue;
+template <class Img>
+static inline int FillGaps2Pixel(Img edgeImg, int stride, int i, int j){
+  int count = 0;
+  int loc = 1;
+  if (edgeImg[(i-1)*stride+j] == 255) count++;
+  if (edgeImg[(i+1)*stride+j] == 255){count++; loc = 2;}
+  if (edgeImg[i*stride+j-1] == 255){count++; loc = 3;}
+  if (edgeImg[i*stride+j+1] == 255){count++; loc = 4;}
+
+  if (edgeImg[(i-1)*stride+j-1] == 255 && edgeImg[(i-1)*stride+j] != 255 && edgeImg[i*stride+j-1] != 255){count++; loc = 5;}
+  if (edgeImg[(i-1)*stride+j+1] == 255 && edgeImg[(i-1)*stride+j] != 255 && edgeImg[i*stride+j+1] != 255){count++; loc = 6;}
+  if (edgeImg[(i+1)*stride+j+1] == 255 && edgeImg[(i+1)*stride+j] != 255 && edgeImg[i*stride+j+1] != 255){count++; loc = 7;}
+  if (edgeImg[(i+1)*stride+j-1] == 255 && edgeImg[(i+1)*stride+j] != 255 && edgeImg[i*stride+j-1] != 255){count++; loc = 8;}
+
+  if (count == 0 || count > 1) return -1;
   
-      // Pixel at the tip of an edge group
-      if (loc == 1){
-        // Going Down
-        // P
-        // x
-        if (edgeImg[(i+2)*width+j] == 255){edgeImg[(i+1)*width+j] = 128; continue;} // Down
-
-        if (edgeImg[(i+2)*width+j+1] == 255 || edgeImg[(i+2)*width+j+2] == 255 || edgeImg[(i+1)*width+j+2] == 255){edgeImg[(i+1)*width+j+1] = 128; continue;} // Down-Right
-        if (edgeImg[(i+2)*width+j-1] == 255 || edgeImg[(i+2)*width+j-2] == 255 || edgeImg[(i+1)*width+j-2] == 255){edgeImg[(i+1)*width+j-1] = 128; continue;} // Down-Left
-
-      } else if (loc == 2){
-        // Going Up
-        // x
-        // P
-        if (edgeImg[(i-2)*width+j] == 255){edgeImg[(i-1)*width+j] = 128; continue;} // Up
-
-        if (edgeImg[(i-2)*width+j+1] == 255 || edgeImg[(i-2)*width+j+2] == 255 || edgeImg[(i-1)*width+j+2] == 255){edgeImg[(i-1)*width+j+1] = 128; continue;} // Up-Right
-        if (edgeImg[(i-2)*width+j-1] == 255 || edgeImg[(i-2)*width+j-2] == 255 || edgeImg[(i-1)*width+j-2] == 255){edgeImg[(i-1)*width+j-1] = 128; continue;} // Up-Left
-
-      } else if (loc == 3){
-        // Going Right
-        // Px
-        if (edgeImg[i*width+j+2] == 255){edgeImg[i*width+j+1] = 128; continue;} // Right
-
-        if (edgeImg[(i-2)*width+j+1] == 255 || edgeImg[(i-2)*width+j+2] == 255 || edgeImg[(i-1)*width+j+2] == 255){edgeImg[(i-1)*width+j+1] = 128; continue;} // Up-Right
-        if (edgeImg[(i+2)*width+j+1] == 255 || edgeImg[(i+2)*width+j+2] == 255 || edgeImg[(i+1)*width+j+2] == 255){edgeImg[(i+1)*width+j+1] = 128; continue;} // Down-Right
-
-      } else if (loc == 4){
-        // Going Left
-        // xP
-        if (edgeImg[i*width+j-2] == 255){edgeImg[i*width+j-1] = 128; continue;} // Left
-
-        if (edgeImg[(i-2)*width+j-1] == 255 || edgeImg[(i-2)*width+j-2] == 255 || edgeImg[(i-1)*width+j-2] == 255){edgeImg[(i-1)*width+j-1] = 128; continue;} // Up-Left
-        if (edgeImg[(i+2)*width+j-1] == 255 || edgeImg[(i+2)*width+j-2] == 255 || edgeImg[(i+1)*width+j-2] == 255){edgeImg[(i+1)*width+j-1] = 128; continue;} // Down-Left
-
-      } else if (loc == 5){
-        // Going Down-Right
-        // P
-        //  x
-        if (edgeImg[(i+2)*width+j+1] == 255 || edgeImg[(i+2)*width+j+2] == 255 || edgeImg[(i+1)*width+j+2] == 255){edgeImg[(i+1)*width+j+1] = 128; continue;} // Down-Right
-
-        if (edgeImg[i*width+j+2] == 255){edgeImg[i*width+j+1] = 128; continue;} // Down
-        if (edgeImg[i*width+j+2] == 255){edgeImg[i*width+j+1] = 128; continue;} // Right
-
-        if (edgeImg[(i+2)*width+j-1] == 255 || edgeImg[(i+2)*width+j-2] == 255 || edgeImg[(i+1)*width+j-2] == 255){edgeImg[(i+1)*width+j-1] = 128; continue;} // Down-Left
-        if (edgeImg[(i-2)*width+j+1] == 255 || edgeImg[(i-2)*width+j+2] == 255 || edgeImg[(i-1)*width+j+2] == 255){edgeImg[(i-1)*width+j+1] = 128; continue;} // Up-Right
-
-      } else if (loc == 6){
-        // Going Down-Left
-        //  P
-        // x
-        if (edgeImg[(i+2)*width+j-1] == 255 || edgeImg[(i+2)*width+j-2] == 255 || edgeImg[(i+1)*width+j-2] == 255){edgeImg[(i+1)*width+j-1] = 128; continue;} // Down-Left
-
-        if (edgeImg[i*width+j+2] == 255){edgeImg[i*width+j+1] = 128; continue;} // Down
-        if (edgeImg[i*width+j-2] == 255){edgeImg[i*width+j-1] = 128; continue;} // Left
-
-        if (edgeImg[(i+2)*width+j+1] == 255 || edgeImg[(i+2)*width+j+2] == 255 || edgeImg[(i+1)*width+j+2] == 255){edgeImg[(i+1)*width+j+1] = 128; continue;} // Down-Right
-        if (edgeImg[(i-2)*width+j-1] == 255 || edgeImg[(i-2)*width+j-2] == 255 || edgeImg[(i-1)*width+j-2] == 255){edgeImg[(i-1)*width+j-1] = 128; continue;} // Up-Left
-
-      } else if (loc == 7){
-        // Going Up-Left
-        // x
-        //  P
-        if (edgeImg[(i-2)*width+j-1] == 255 || edgeImg[(i-2)*width+j-2] == 255 || edgeImg[(i-1)*width+j-2] == 255){edgeImg[(i-1)*width+j-1] = 128; continue;} // Up-Left
-
-        if (edgeImg[(i-2)*width+j] == 255){edgeImg[(i-1)*width+j] = 128; continue;} // Up
-        if (edgeImg[i*width+j-2] == 255){edgeImg[i*width+j-1] = 128; continue;} // Left
-
-        if (edgeImg[(i-2)*width+j+1] == 255 || edgeImg[(i-2)*width+j+2] == 255 || edgeImg[(i-1)*width+j+2] == 255){edgeImg[(i-1)*width+j+1] = 128; continue;} // Up-Right
-        if (edgeImg[(i+2)*width+j-1] == 255 || edgeImg[(i+2)*width+j-2] == 255 || edgeImg[(i+1)*width+j-2] == 255){edgeImg[(i+1)*width+j-1] = 128; continue;} // Down-Left
-
-      } else { //if (loc == 8){
-        // Going Up-Right
-        //  x
-        // P
-        if (edgeImg[(i-2)*width+j+1] == 255 || edgeImg[(i-2)*width+j+2] == 255 || edgeImg[(i-1)*width+j+2] == 255){edgeImg[(i-1)*width+j+1] = 128; continue;} // Up-Right
-
-        if (edgeImg[(i-2)*width+j] == 255){edgeImg[(i-1)*width+j] = 128; continue;} // Up
-        if (edgeImg[i*width+j+2] == 255){edgeImg[i*width+j+1] = 128; continue;} // Right
-
-        if (edgeImg[(i-2)*width+j-1] == 255 || edgeImg[(i-2)*width+j-2] == 255 || edgeImg[(i-1)*width+j-2] == 255){edgeImg[(i-1)*width+j-1] = 128; continue;} // Up-Left
-        if (edgeImg[(i+2)*width+j+1] == 255 || edgeImg[(i+2)*width+j+2] == 255 || edgeImg[(i+1)*width+j+2] == 255){edgeImg[(i+1)*width+j+1] = 128; continue;} // Down-Right
-      } //end-else 
-    } //end-for
-  } //end-for
+  // Pixel at the tip of an edge group
+  if (loc == 1){
+    // Going Down
+    // P
+    // x
+    if (edgeImg[(i+2)*stride+j] == 255) return (i+1)*stride+j; // Down
 
-  for (int i=0; i<width*height; i++) if (edgeImg[i] == 128) edgeImg[i] = 255;
-} //end-FillGaps2
+    if (edgeImg[(i+2)*stride+j+1] == 255 || edgeImg[(i+2)*stride+j+2] == 255 || edgeImg[(i+1)*stride+j+2] == 255) return (i+1)*stride+j+1; // Down-Right
+    if (edgeImg[(i+2)*stride+j-1] == 255 || edgeImg[(i+2)*stride+j-2] == 255 || edgeImg[(i+1)*stride+j-2] == 255) return (i+1)*stride+j-1; // Down-Left
 
+  } else if (loc == 2){
+    // Going Up
+    // x
+    // P
+    if (edgeImg[(i-2)*stride+j] == 255) return (i-1)*stride+j; // Up
 
-///======================================= Step 2: EdgeSegment Creation by 8 Directional Walk ======================================
-#define UP_LEFT    1   // diagonal
-#define UP         2   
-#define UP_RIGHT   3
-#define RIGHT      4
-#define DOWN_RIGHT 5
-#define DOWN       6
-#define DOWN_LEFT  7
-#define LEFT       8
+    if (edgeImg[(i-2)*stride+j+1] == 255 || edgeImg[(i-2)*stride+j+2] == 255 || edgeImg[(i-1)*stride+j+2] == 255) return (i-1)*stride+j+1; // Up-Right
+    if (edgeImg[(i-2)*stride+j-1] == 255 || edgeImg[(i-2)*stride+j-2] == 255 || edgeImg[(i-1)*stride+j-2] == 255) return (i-1)*stride+j-1; // Up-Left
 
-///-----------------------------------------------------------------------------------------------
-/// Next direction prediction engine (Use the last 8 directions to make a prediction for the next)
-///
-struct Queue {
-#define QSIZE 8
-  int Q[QSIZE];
-  int noItems;
-  int rear;
+  } else if (loc == 3){
+    // Going Right
+    // Px
+    if (edgeImg[i*stride+j+2] == 255) return i*stride+j+1; // Right
 
-  Queue(){noItems = 0; rear = 0;}
+    if (edgeImg[(i-2)*stride+j+1] == 255 || edgeImg[(i-2)*stride+j+2] == 255 || edgeImg[(i-1)*stride+j+2] == 255) return (i-1)*stride+j+1; // Up-Right
+    if (edgeImg[(i+2)*stride+j+1] == 255 || edgeImg[(i+2)*stride+j+2] == 255 || edgeImg[(i+1)*stride+j+2] == 255) return (i+1)*stride+j+1; // Down-Right
 
-   void Add(int dir){
-    Q[rear++] = dir;
-    if (rear >= QSIZE) rear = 0;
-    if (noItems < QSIZE) noItems++;
-  } //end-add
+  } else if (loc == 4){
+    // Going Left
+    // xP
+    if (edgeImg[i*stride+j-2] == 255) return i*stride+j-1; // Left
 
-  int ComputeNextDir(int analysisDir){
-    int C[2] = {0, 0};
+    if (edgeImg[(i-2)*stride+j-1] == 255 || edgeImg[(i-2)*stride+j-2] == 255 || edgeImg[(i-1)*stride+j-2] == 255) return (i-1)*stride+j-1; // Up-Left
+    if (edgeImg[(i+2)*stride+j-1] == 255 || edgeImg[(i+2)*stride+j-2] == 255 || edgeImg[(i+1)*stride+j-2] == 255) return (i+1)*stride+j-1; // Down-Left
 
-    if (analysisDir == LEFT || analysisDir == RIGHT){
-      // LEFT or RIGHT
-      for (int i=0; i<noItems; i++){
-        if (Q[i] == UP || Q[i] == DOWN) continue;
+  } else if (loc == 5){
+    // Going Down-Right
+    // P
+    //  x
+    if (edgeImg[(i+2)*stride+j+1] == 255 || edgeImg[(i+2)*stride+j+2] == 255 || edgeImg[(i+1)*stride+j+2] == 255) return (i+1)*stride+j+1; // Down-Right
 
-        if (Q[i] == LEFT || Q[i] == DOWN_LEFT || Q[i] == UP_LEFT) C[0]++;
-        else                                                      C[1]++;
-     } //end-for
+    if (edgeImg[i*stride+j+2] == 255) return i*stride+j+1; // Down
+    if (edgeImg[i*stride+j+2] == 255) return i*stride+j+1; // Right
 
-      if (C[0] >= C[1]) return LEFT;
-      else              return RIGHT;
+    if (edgeImg[(i+2)*stride+j-1] == 255 || edgeImg[(i+2)*stride+j-2] == 255 || edgeImg[(i+1)*stride+j-2] == 255) return (i+1)*stride+j-1; // Down-Left
+    if (edgeImg[(i-2)*stride+j+1] == 255 || edgeImg[(i-2)*stride+j+2] == 255 || edgeImg[(i-1)*stride+j+2] == 255) return (i-1)*stride+j+1; // Up-Right
 
-    } else if (analysisDir == UP || analysisDir == DOWN){
-      // UP or DOWN
-      for (int i=0; i<noItems; i++){
-        if (Q[i] == LEFT || Q[i] == RIGHT) continue;
+  } else if (loc == 6){
+    // Going Down-Left
+    //  P
+    // x
+    if (edgeImg[(i+2)*stride+j-1] == 255 || edgeImg[(i+2)*stride+j-2] == 255 || edgeImg[(i+1)*stride+j-2] == 255) return (i+1)*stride+j-1; // Down-Left
 
-        if (Q[i] == UP || Q[i] == UP_LEFT || Q[i] == UP_RIGHT) C[0]++;
-        else                                                   C[1]++;
-      } //end-for
+    if (edgeImg[i*stride+j+2] == 255) return i*stride+j+1; // Down
+    if (edgeImg[i*stride+j-2] == 255) return i*stride+j-1; // Left
 
-      if (C[0] >= C[1]) return UP;
-      else              return DOWN;
+    if (edgeImg[(i+2)*stride+j+1] == 255 || edgeImg[(i+2)*stride+j+2] == 255 || edgeImg[(i+1)*stride+j+2] == 255) return (i+1)*stride+j+1; // Down-Right
+    if (edgeImg[(i-2)*stride+j-1] == 255 || edgeImg[(i-2)*stride+j-2] == 255 || edgeImg[(i-1)*stride+j-2] == 255) return (i-1)*stride+j-1; // Up-Left
 
-    } else if (analysisDir == UP_LEFT){
-      // UP or LEFT
-      for (int i=0; i<noItems; i++){
-        if      (Q[i] == UP)   C[0]++;
-        else if (Q[i] == LEFT) C[1]++;
-      } //end-for
+  } else if (loc == 7){
+    // Going Up-Left
+    // x
+    //  P
+    if (edgeImg[(i-2)*stride+j-1] == 255 || edgeImg[(i-2)*stride+j-2] == 255 || edgeImg[(i-1)*stride+j-2] == 255) return (i-1)*stride+j-1; // Up-Left
 
-      if (C[0] >= C[1]) return UP;
-      else              return LEFT;
+    if (edgeImg[(i-2)*stride+j] == 255) return (i-1)*stride+j; // Up
+    if (edgeImg[i*stride+j-2] == 255) return i*stride+j-1; // Left
 
-    } else if (analysisDir == UP_RIGHT){
-      // UP or RIGHT
-      for (int i=0; i<noItems; i++){
-        if      (Q[i] == UP)    C[0]++;
-        else if (Q[i] == RIGHT) C[1]++;
-      } //end-for
+    if (edgeImg[(i-2)*stride+j+1] == 255 || edgeImg[(i-2)*stride+j+2] == 255 || edgeImg[(i-1)*stride+j+2] == 255) return (i-1)*stride+j+1; // Up-Right
+    if (edgeImg[(i+2)*stride+j-1] == 255 || edgeImg[(i+2)*stride+j-2] == 255 || edgeImg[(i+1)*stride+j-2] == 255) return (i+1)*stride+j-1; // Down-Left
 
-      if (C[0] >= C[1]) return UP;
-      else              return RIGHT;
+  } else { //if (loc == 8){
+    // Going Up-Right
+    //  x
+    // P
+    if (edgeImg[(i-2)*stride+j+1] == 255 || edgeImg[(i-2)*stride+j+2] == 255 || edgeImg[(i-1)*stride+j+2] == 255) return (i-1)*stride+j+1; // Up-Right
 
-    } else if (analysisDir == DOWN_RIGHT){
-      // DOWN or RIGHT
-      for (int i=0; i<noItems; i++){
-        if      (Q[i] == DOWN)  C[0]++;
-        else if (Q[i] == RIGHT) C[1]++;
-      } //end-for
+    if (edgeImg[(i-2)*stride+j] == 255) return (i-1)*stride+j; // Up
+    if (edgeImg[i*stride+j+2] == 255) return i*stride+j+1; // Right
 
-      if (C[0] >= C[1]) return DOWN;
-      else              return RIGHT;
+    if (edgeImg[(i-2)*stride+j-1] == 255 || edgeImg[(i-2)*stride+j-2] == 255 || edgeImg[(i-1)*stride+j-2] == 255) return (i-1)*stride+j-1; // Up-Left
+    if (edgeImg[(i+2)*stride+j+1] == 255 || edgeImg[(i+2)*stride+j+2] == 255 || edgeImg[(i+1)*stride+j+2] == 255) return (i+1)*stride+j+1; // Down-Right
+  } //end-else 
 
-    } else { //if (analysisDir == DOWN_LEFT){
-      // DOWN or LEFT
-      for (int i=0; i<noItems; i++){
-        if      (Q[i] == DOWN)  C[0]++;
-        else if (Q[i] == LEFT) C[1]++;
-      } //end-for
+  return -1;
+} //end-FillGaps2Pixel
 
-      if (C[0] >= C[1]) return DOWN;
-      else              return LEFT;
-    } // end-else
-  } //end-ComputeNextDir
+///---------------------------------------------------------------------------------
+/// Where FillGaps2 marks the gap pixels: With 128 in the edge map itself, or for a read-only edge
+/// map, in the edgel bitmap of the context (see ConstEdgels). The gaps are added to the index if any
+///
+struct GapMarks {
+  unsigned char *edgeImg;       // Edge map marked in place, NULL to mark the bitmap
+  const unsigned char *src;     // Read-only edge map of the bitmap
+  unsigned char *bits;          // Edgel bitmap, 1 bit per pixel at the same offsets as the edge map
+  EdgelIndex *index;
+  int stride;
+  int noGaps;                   // # of gaps marked in the bitmap
+
+  void Mark(int p){
+    if (edgeImg) edgeImg[p] = 128;
+    else if (src[p] == 0 && (bits[p>>3] & (1<<(p&7))) == 0){bits[p>>3] |= (unsigned char)(1<<(p&7)); noGaps++;}
+
+    if (index) index->Mark(p/stride, p%stride);
+  } //end-Mark
 };
 
-///----------------------------------------------------------------------------------------------------
-/// 8 Directional Walk with Prediction
+///---------------------------------------------------------------------------------
+/// Turn the gap pixels marked with 128 into edgels. Returns the # of edgels & the # of gaps in "noGaps"
 ///
-static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c, int dir, Pixel *pixels){
-  Queue Q;
+static int FillGaps2Finish(unsigned char *edgeImg, int width, int height, int stride, int *noGaps){
+  int noEdgels = 0;
+  *noGaps = 0;
+  for (int i=0; i<height; i++){
+    unsigned char *row = edgeImg + i*stride;
+    for (int j=0; j<width; j++){
+      if (row[j] == 128){row[j] = 255; (*noGaps)++;}
+      if (row[j]) noEdgels++;
+    } //end-for
+  } //end-for
 
-  int count = 0;
+  return noEdgels;
+} //end-FillGaps2Finish
 
-  while (1){
-    edgeImg[r*width+c] = 0;
+///---------------------------------------------------------------------------------
+/// Finds the gaps of 1 pixel wide: This joins the tip of an edge group to ANY neighbouring edgel
+///
+static void FillGaps2Classify(const unsigned char *edgeImg, int width, int height, int stride, GapMarks *marks){
+  for (int i=2; i<height-2; i++){
+    for (int j=2; j<width-2; j++){
+      if (edgeImg[i*stride+j] != 255) continue;
 
-    if (r<=0 || r>=height-1) return count;
-    if (c<=0 || c>=width-1) return count;
+      int gap = FillGaps2Pixel(edgeImg, stride, i, j);
+      if (gap >= 0) marks->Mark(gap);
+    } //end-for
+  } //end-for
+} //end-FillGaps2Classify
 
-    pixels[count].r = r;
-    pixels[count].c = c;
-    count++;
+///---------------------------------------------------------------------------------
+/// Close gaps of 1 pixel wide
+/// Returns the # of edgels in the filled-up edge map & the # of gaps filled in "noGaps"
+///
+static int FillGaps2(unsigned char *edgeImg, int width, int height, int stride, int *noGaps){
+  GapMarks marks = {edgeImg, edgeImg, NULL, NULL, stride, 0};
+  FillGaps2Classify(edgeImg, width, height, stride, &marks);
 
-    // Add the current direction to the Q
-    Q.Add(dir);
+  return FillGaps2Finish(edgeImg, width, height, stride, noGaps);
+} //end-FillGaps2
 
-    if        (dir == UP_LEFT){
-      // Should we check UP or LEFT first?
-      int nextDir = Q.ComputeNextDir(UP_LEFT);
+///---------------------------------------------------------------------------------
+/// FillGaps2Classify visiting only the blocks of the edgel index. A gap added to the index by
+/// "marks" may open a new block, which holds no edgel to visit
+///
+static void FillGaps2ClassifySparse(const unsigned char *edgeImg, int width, int height, int stride, const EdgelIndex *index, GapMarks *marks){
+  for (int i=2; i<height-2; i++){
+    for (int b=index->NextBlock(i, 0); b>=0; b=index->NextBlock(i, b+1)){
+      int j0 = 8*b < 2 ? 2 : 8*b;
+      int j1 = 8*b+8 < width-2 ? 8*b+8 : width-2;
 
-      // Up-Left?
-      if (edgeImg[(r-1)*width+c-1]){
-        if (nextDir == UP){
-          // Up?
-          if (edgeImg[(r-1)*width+c]){
-            pixels[count].r = r-1; pixels[count].c = c; count++;
-            edgeImg[(r-1)*width+c] = 0;
+      for (int j=j0; j<j1; j++){
+        if (edgeImg[i*stride+j] != 255) continue;
 
-          // Left?
-          } else if (edgeImg[r*width+c-1]){
-            pixels[count].r = r; pixels[count].c = c-1; count++;
-            edgeImg[r*width+c-1] = 0;
-          } //end-else
+        int gap = FillGaps2Pixel(edgeImg, stride, i, j);
+        if (gap >= 0) marks->Mark(gap);
+      } //end-for
+    } //end-for
+  } //end-for
+} //end-FillGaps2ClassifySparse
 
-        } else {
-          // Left?
-          if (edgeImg[r*width+c-1]){
-            pixels[count].r = r; pixels[count].c = c-1; count++;
-            edgeImg[r*width+c-1] = 0;
+///---------------------------------------------------------------------------------
+/// FillGaps2 visiting only the blocks of the edgel index. The gap pixels are added to the index
+/// Returns the # of edgels in the filled-up edge map & the # of gaps filled in "noGaps"
+///
+static int FillGaps2Sparse(unsigned char *edgeImg, int width, int height, int stride, EdgelIndex *index, int *noGaps){
+  GapMarks marks = {edgeImg, edgeImg, NULL, index, stride, 0};
+  FillGaps2ClassifySparse(edgeImg, width, height, stride, index, &marks);
+
+  // Turn the gap pixels into edgels
+  int noEdgels = 0;
+  *noGaps = 0;
+  for (int i=0; i<height; i++){
+    for (int b=index->NextBlock(i, 0); b>=0; b=index->NextBlock(i, b+1)){
+      int j1 = 8*b+8 < width ? 8*b+8 : width;
+
+      for (int j=8*b; j<j1; j++){
+        if (edgeImg[i*stride+j] == 128){edgeImg[i*stride+j] = 255; (*noGaps)++;}
+        if (edgeImg[i*stride+j]) noEdgels++;
+      } //end-for
+    } //end-for
+  } //end-for
 
-          // Up?
-          } else if (edgeImg[(r-1)*width+c]){
-            pixels[count].r = r-1; pixels[count].c = c; count++;
-            edgeImg[(r-1)*width+c] = 0;
-          } //end-else
-        } //end-else
+  return noEdgels;
+} //end-FillGaps2Sparse
 
-        r--; c--; dir = UP_LEFT; continue;
-      } // end-if
+///---------------------------------------------------------------------------------
+/// Returns the # of nonzero pixels of a read-only edge map, visiting only the blocks of the index if any
+///
+static int CountEdgels(const unsigned char *edgeImg, int width, int height, int stride, const EdgelIndex *index){
+  int noEdgels = 0;
+  for (int i=0; i<height; i++){
+    const unsigned char *row = edgeImg + i*stride;
 
-      if (nextDir == UP){
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+    if (index == NULL){
+      for (int j=0; j<width; j++) noEdgels += row[j] != 0;
+      continue;
+    } //end-if
 
-        // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+    for (int b=index->NextBlock(i, 0); b>=0; b=index->NextBlock(i, b+1)){
+      int j1 = 8*b+8 < width ? 8*b+8 : width;
+      for (int j=8*b; j<j1; j++) noEdgels += row[j] != 0;
+    } //end-for
+  } //end-for
 
-        // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+  return noEdgels;
+} //end-CountEdgels
 
-        // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+///---------------------------------------------------------------------------------
+/// SIMD FillGaps2: Classifies 16 (SSE2) or 32 (AVX2) pixels at a time & runs FillGaps2Pixel only
+/// for the tips of the edge groups. The gap pixels are marked with 128, which never changes whether
+/// a pixel is 255, so the classification does not depend on the order the pixels are visited in and
+/// the result is identical to FillGaps2
+///
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PEL_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PEL_TARGET_AVX2
+#define PEL_CTZ(x) _tzcnt_u32(x)
+#else
+#define PEL_TARGET_AVX2 __attribute__((target("avx2")))
+#define PEL_CTZ(x) __builtin_ctz(x)
+#endif
 
-        // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+///---------------------------------------------------------------------------------
+/// Runs FillGaps2Pixel for every pixel set in "tips" starting at column j
+///
+static inline void FillGaps2Tips(const unsigned char *edgeImg, int stride, int i, int j, unsigned int tips, GapMarks *marks){
+  while (tips){
+    int gap = FillGaps2Pixel(edgeImg, stride, i, j+PEL_CTZ(tips));
+    if (gap >= 0) marks->Mark(gap);
+    tips &= tips-1;
+  } //end-while
+} //end-FillGaps2Tips
 
-        // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+static void FillGaps2ClassifySSE2(const unsigned char *edgeImg, int width, int height, int stride, GapMarks *marks){
+  const __m128i v255 = _mm_set1_epi8((char)255);
+  const __m128i vMinus1 = _mm_set1_epi8(-1);
 
-      } else {
-        // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+  for (int i=2; i<height-2; i++){
+    const unsigned char *up = edgeImg + (i-1)*stride;
+    const unsigned char *cur = edgeImg + i*stride;
+    const unsigned char *down = edgeImg + (i+1)*stride;
+
+    int j = 2;
+    for (; j+16 <= width-2; j+=16){
+      __m128i C = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cur+j)), v255);
+      if (_mm_movemask_epi8(C) == 0) continue;
+
+      __m128i N = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up+j)), v255);
+      __m128i S = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down+j)), v255);
+      __m128i W = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cur+j-1)), v255);
+      __m128i E = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cur+j+1)), v255);
+      __m128i NW = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up+j-1)), v255);
+      __m128i NE = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up+j+1)), v255);
+      __m128i SE = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down+j+1)), v255);
+      __m128i SW = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down+j-1)), v255);
+
+      // Diagonal neighbors count only if both adjacent 4-neighbors are empty
+      NW = _mm_andnot_si128(_mm_or_si128(N, W), NW);
+      NE = _mm_andnot_si128(_mm_or_si128(N, E), NE);
+      SE = _mm_andnot_si128(_mm_or_si128(S, E), SE);
+      SW = _mm_andnot_si128(_mm_or_si128(S, W), SW);
+
+      // Masks are -1, so the sum is -count
+      __m128i sum = _mm_add_epi8(_mm_add_epi8(_mm_add_epi8(N, S), _mm_add_epi8(W, E)),
+                                 _mm_add_epi8(_mm_add_epi8(NW, NE), _mm_add_epi8(SE, SW)));
+      __m128i tips = _mm_and_si128(C, _mm_cmpeq_epi8(sum, vMinus1));
+
+      FillGaps2Tips(edgeImg, stride, i, j, _mm_movemask_epi8(tips), marks);
+    } //end-for
 
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+    for (; j<width-2; j++){
+      if (cur[j] != 255) continue;
 
-        // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+      int gap = FillGaps2Pixel(edgeImg, stride, i, j);
+      if (gap >= 0) marks->Mark(gap);
+    } //end-for
+  } //end-for
+} //end-FillGaps2ClassifySSE2
+
+static int FillGaps2SSE2(unsigned char *edgeImg, int width, int height, int stride, int *noGaps){
+  GapMarks marks = {edgeImg, edgeImg, NULL, NULL, stride, 0};
+  FillGaps2ClassifySSE2(edgeImg, width, height, stride, &marks);
+
+  // Turn the gap pixels into edgels & count the edgels and the gaps
+  // Contiguous rows are done as a single row
+  const __m128i v128 = _mm_set1_epi8((char)128);
+  const __m128i v127 = _mm_set1_epi8(127);
+  const __m128i v1 = _mm_set1_epi8(1);
+  const __m128i zero = _mm_setzero_si128();
+  int noRows = stride == width ? 1 : height;
+  int n = stride == width ? width*height : width;
+  int noEdgels = 0;
+  *noGaps = 0;
+  __m128i zeros = zero;  // # of empty pixels in two 64 bit counters
+  __m128i gaps = zero;   // # of gap pixels in two 64 bit counters
+
+  for (int r=0; r<noRows; r++){
+    unsigned char *row = edgeImg + r*stride;
+
+    int i = 0;
+    for (; i+16<=n; i+=16){
+      __m128i v = _mm_loadu_si128((__m128i *)(row+i));
+      __m128i G = _mm_cmpeq_epi8(v, v128);
+      v = _mm_or_si128(v, _mm_and_si128(G, v127));
+      _mm_storeu_si128((__m128i *)(row+i), v);
+
+      zeros = _mm_add_epi64(zeros, _mm_sad_epu8(_mm_and_si128(_mm_cmpeq_epi8(v, zero), v1), zero));
+      gaps = _mm_add_epi64(gaps, _mm_sad_epu8(_mm_and_si128(G, v1), zero));
+    } //end-for
 
-        // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+    noEdgels += i;
+    for (; i<n; i++){
+      if (row[i] == 128){row[i] = 255; (*noGaps)++;}
+      if (row[i]) noEdgels++;
+    } //end-for
+  } //end-for
 
-        // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+  noEdgels -= _mm_cvtsi128_si32(zeros) + _mm_cvtsi128_si32(_mm_srli_si128(zeros, 8));
+  *noGaps += _mm_cvtsi128_si32(gaps) + _mm_cvtsi128_si32(_mm_srli_si128(gaps, 8));
 
-        // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
-      } //end-else
+  return noEdgels;
+} //end-FillGaps2SSE2
 
-      // Nowhere to go
-      return count;
+PEL_TARGET_AVX2
+static void FillGaps2ClassifyAVX2(const unsigned char *edgeImg, int width, int height, int stride, GapMarks *marks){
+  const __m256i v255 = _mm256_set1_epi8((char)255);
+  const __m256i vMinus1 = _mm256_set1_epi8(-1);
 
-    } else if (dir == UP){
-      // Up
-      if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+  for (int i=2; i<height-2; i++){
+    const unsigned char *up = edgeImg + (i-1)*stride;
+    const unsigned char *cur = edgeImg + i*stride;
+    const unsigned char *down = edgeImg + (i+1)*stride;
+
+    int j = 2;
+    for (; j+32 <= width-2; j+=32){
+      __m256i C = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cur+j)), v255);
+      if (_mm256_movemask_epi8(C) == 0) continue;
+
+      __m256i N = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up+j)), v255);
+      __m256i S = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down+j)), v255);
+      __m256i W = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cur+j-1)), v255);
+      __m256i E = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cur+j+1)), v255);
+      __m256i NW = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up+j-1)), v255);
+      __m256i NE = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up+j+1)), v255);
+      __m256i SE = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down+j+1)), v255);
+      __m256i SW = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down+j-1)), v255);
+
+      NW = _mm256_andnot_si256(_mm256_or_si256(N, W), NW);
+      NE = _mm256_andnot_si256(_mm256_or_si256(N, E), NE);
+      SE = _mm256_andnot_si256(_mm256_or_si256(S, E), SE);
+      SW = _mm256_andnot_si256(_mm256_or_si256(S, W), SW);
+
+      __m256i sum = _mm256_add_epi8(_mm256_add_epi8(_mm256_add_epi8(N, S), _mm256_add_epi8(W, E)),
+                                    _mm256_add_epi8(_mm256_add_epi8(NW, NE), _mm256_add_epi8(SE, SW)));
+      __m256i tips = _mm256_and_si256(C, _mm256_cmpeq_epi8(sum, vMinus1));
+
+      FillGaps2Tips(edgeImg, stride, i, j, (unsigned int)_mm256_movemask_epi8(tips), marks);
+    } //end-for
 
-      // Should we check LEFT or RIGHT first?
+    for (; j<width-2; j++){
+      if (cur[j] != 255) continue;
+
+      int gap = FillGaps2Pixel(edgeImg, stride, i, j);
+      if (gap >= 0) marks->Mark(gap);
+    } //end-for
+  } //end-for
+} //end-FillGaps2ClassifyAVX2
+
+PEL_TARGET_AVX2
+static int FillGaps2AVX2(unsigned char *edgeImg, int width, int height, int stride, int *noGaps){
+  GapMarks marks = {edgeImg, edgeImg, NULL, NULL, stride, 0};
+  FillGaps2ClassifyAVX2(edgeImg, width, height, stride, &marks);
+
+  const __m256i v128 = _mm256_set1_epi8((char)128);
+  const __m256i v127 = _mm256_set1_epi8(127);
+  const __m256i v1 = _mm256_set1_epi8(1);
+  const __m256i zero = _mm256_setzero_si256();
+  int noRows = stride == width ? 1 : height;
+  int n = stride == width ? width*height : width;
+  int noEdgels = 0;
+  *noGaps = 0;
+  __m256i zeros = zero;  // # of empty pixels in four 64 bit counters
+  __m256i gaps = zero;   // # of gap pixels in four 64 bit counters
+
+  for (int r=0; r<noRows; r++){
+    unsigned char *row = edgeImg + r*stride;
+
+    int i = 0;
+    for (; i+32<=n; i+=32){
+      __m256i v = _mm256_loadu_si256((__m256i *)(row+i));
+      __m256i G = _mm256_cmpeq_epi8(v, v128);
+      v = _mm256_or_si256(v, _mm256_and_si256(G, v127));
+      _mm256_storeu_si256((__m256i *)(row+i), v);
+
+      zeros = _mm256_add_epi64(zeros, _mm256_sad_epu8(_mm256_and_si256(_mm256_cmpeq_epi8(v, zero), v1), zero));
+      gaps = _mm256_add_epi64(gaps, _mm256_sad_epu8(_mm256_and_si256(G, v1), zero));
+    } //end-for
+
+    noEdgels += i;
+    for (; i<n; i++){
+      if (row[i] == 128){row[i] = 255; (*noGaps)++;}
+      if (row[i]) noEdgels++;
+    } //end-for
+  } //end-for
+
+  long long noZeros[4], noGapPixels[4];
+  _mm256_storeu_si256((__m256i *)noZeros, zeros);
+  _mm256_storeu_si256((__m256i *)noGapPixels, gaps);
+
+  noEdgels -= (int)(noZeros[0] + noZeros[1] + noZeros[2] + noZeros[3]);
+  *noGaps += (int)(noGapPixels[0] + noGapPixels[1] + noGapPixels[2] + noGapPixels[3]);
+
+  return noEdgels;
+} //end-FillGaps2AVX2
+
+///---------------------------------------------------------------------------------
+/// Does the CPU & the OS support AVX2?
+///
+static bool HasAVX2(){
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1<<27)) != 0;
+  bool avx = (info[2] & (1<<28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1<<5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+} //end-HasAVX2
+#endif
+
+typedef int (*FillGapsFunc)(unsigned char *edgeImg, int width, int height, int stride, int *noGaps);
+typedef void (*ClassifyFunc)(const unsigned char *edgeImg, int width, int height, int stride, GapMarks *marks);
+
+///---------------------------------------------------------------------------------
+/// FillGaps2 with the widest SIMD instruction set of the CPU, chosen once at runtime
+///
+static int FillGaps2SIMD(unsigned char *edgeImg, int width, int height, int stride, int *noGaps){
+#ifdef PEL_X86
+  static const FillGapsFunc fillGaps = HasAVX2() ? FillGaps2AVX2 : FillGaps2SSE2;
+#else
+  static const FillGapsFunc fillGaps = FillGaps2;
+#endif
+
+  return fillGaps(edgeImg, width, height, stride, noGaps);
+} //end-FillGaps2SIMD
+
+///---------------------------------------------------------------------------------
+/// FillGaps2 on a read-only edge map: The gaps are marked in the edgel bitmap "bits" instead, which
+/// is cleared here for the rows of the edge map. Returns the # of edgels in the filled-up edge map
+/// & the # of gaps filled in "noGaps"
+///
+static int FillGaps2Const(const unsigned char *edgeImg, int width, int height, int stride, unsigned char *bits, EdgelIndex *index, bool useSIMD, int *noGaps){
+  if (stride == width) memset(bits, 0, (width*height+7)/8);
+  else {
+    for (int i=0; i<height; i++) memset(bits + (i*stride>>3), 0, ((i*stride+width-1)>>3) - (i*stride>>3) + 1);
+  } //end-else
+
+  GapMarks marks = {NULL, edgeImg, bits, index, stride, 0};
+
+  if (index) FillGaps2ClassifySparse(edgeImg, width, height, stride, index, &marks);
+  else if (useSIMD){
+#ifdef PEL_X86
+    static const ClassifyFunc classify = HasAVX2() ? FillGaps2ClassifyAVX2 : FillGaps2ClassifySSE2;
+#else
+    static const ClassifyFunc classify = FillGaps2Classify;
+#endif
+    classify(edgeImg, width, height, stride, &marks);
+
+  } else {
+    FillGaps2Classify(edgeImg, width, height, stride, &marks);
+  } //end-else
+
+  *noGaps = marks.noGaps;
+  return CountEdgels(edgeImg, width, height, stride, index) + marks.noGaps;
+} //end-FillGaps2Const
+
+///---------------------------------------------------------------------------------
+/// Trailing zeros & set bits of a 64 bit word
+///
+static inline int Ctz64(unsigned long long x){
+#if defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward64(&i, x);
+  return (int)i;
+#else
+  return __builtin_ctzll(x);
+#endif
+} //end-Ctz64
+
+static inline int Popcount64(unsigned long long x){
+#if defined(_MSC_VER)
+  return (int)__popcnt64(x);
+#else
+  return __builtin_popcountll(x);
+#endif
+} //end-Popcount64
+
+///---------------------------------------------------------------------------------
+/// Packs an edge map into two bitmaps of "wordsPerRow" 64 bit words per row: The nonzero pixels
+/// (the edgels) & the pixels equal to 255 (looked at by FillGaps2). Bit c%64 of word c/64 of a row
+/// is column c. The bits past the width are cleared, which leaves at least one empty word after
+/// each row, so the neighbors of the first & last words of a row can be read without a check
+///
+static void PackEdgeMap(const unsigned char *edgeImg, int width, int height, int stride, unsigned long long *edgels, unsigned long long *strong, int wordsPerRow){
+  for (int i=0; i<height; i++){
+    const unsigned char *row = edgeImg + i*stride;
+    unsigned long long *edgelRow = edgels + i*wordsPerRow;
+    unsigned long long *strongRow = strong + i*wordsPerRow;
+
+    int k = 0;
+#ifdef PEL_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v255 = _mm_set1_epi8((char)255);
+
+    for (; 64*k+64 <= width; k++){
+      unsigned long long empty = 0, full = 0;
+      for (int q=0; q<4; q++){
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + 64*k + 16*q));
+        empty |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) << (16*q);
+        full |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, v255)) << (16*q);
+      } //end-for
+
+      edgelRow[k] = ~empty;
+      strongRow[k] = full;
+    } //end-for
+#endif
+
+    for (; k<wordsPerRow; k++){
+      unsigned long long edgel = 0, full = 0;
+      for (int b=0; b<64 && 64*k+b < width; b++){
+        edgel |= (unsigned long long)(row[64*k+b] != 0) << b;
+        full |= (unsigned long long)(row[64*k+b] == 255) << b;
+      } //end-for
+
+      edgelRow[k] = edgel;
+      strongRow[k] = full;
+    } //end-for
+  } //end-for
+} //end-PackEdgeMap
+
+///---------------------------------------------------------------------------------
+/// PackEdgeMap for a bit-packed edge map of "stride" bytes per row, whose bytes hold 8 pixels
+/// each with the leftmost one in the most significant bit (as a PBM image): The bits of every
+/// byte are reversed. Each edgel counts as a pixel equal to 255, so the two bitmaps are the same
+///
+static void PackEdgeBits(const unsigned char *bits, int width, int height, int stride, unsigned long long *edgels, unsigned long long *strong, int wordsPerRow){
+  int noBytes = (width+7)/8;
+
+  for (int i=0; i<height; i++){
+    const unsigned char *row = bits + i*stride;
+    unsigned long long *edgelRow = edgels + i*wordsPerRow;
+
+    for (int k=0; k<wordsPerRow; k++){
+      unsigned long long word = 0;
+      if (8*k+8 <= noBytes){
+        for (int m=0; m<8; m++) word |= (unsigned long long)row[8*k+m] << (8*m);
+      } else {
+        for (int m=0; 8*k+m < noBytes; m++) word |= (unsigned long long)row[8*k+m] << (8*m);
+      } //end-else
+
+      word = ((word >> 1) & 0x5555555555555555ULL) | ((word & 0x5555555555555555ULL) << 1);
+      word = ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+      word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+
+      // The padding bits of the last byte of a row may be set
+      if (64*k+64 > width) word &= 64*k >= width ? 0 : ~0ULL >> (64*k+64 - width);
+      edgelRow[k] = word;
+    } //end-for
+  } //end-for
+
+  memcpy(strong, edgels, sizeof(unsigned long long)*height*wordsPerRow);
+} //end-PackEdgeBits
+
+///---------------------------------------------------------------------------------
+/// Pixels equal to 255 of the strong bitmap for FillGaps2Pixel
+///
+struct StrongBits {
+  const unsigned long long *words;
+
+  int operator[](int o) const {return ((words[o>>6] >> (o&63)) & 1) ? 255 : 0;}
+};
+
+///---------------------------------------------------------------------------------
+/// FillGaps2 on the bitmaps of PackEdgeMap: The tips of the edge groups are found 64 pixels
+/// at a time from the "strong" bitmap, and their gaps are set in the "edgels" bitmap. The strong
+/// bitmap is not changed, so the result is identical to FillGaps2. Returns the # of edgels in the
+/// filled-up bitmap & the # of gaps filled in "noGaps"
+///
+static int FillGaps2Bitmap(const unsigned long long *strong, unsigned long long *edgels, int width, int height, int wordsPerRow, int *noGaps){
+  StrongBits strongBits = {strong};
+  int stride = 64*wordsPerRow;
+  int noWords = (width-2+63)/64;   // Words holding the columns [2, width-2)
+  *noGaps = 0;
+
+  for (int i=2; i<height-2; i++){
+    const unsigned long long *up = strong + (i-1)*wordsPerRow;
+    const unsigned long long *cur = strong + i*wordsPerRow;
+    const unsigned long long *down = strong + (i+1)*wordsPerRow;
+
+    for (int k=0; k<noWords; k++){
+      unsigned long long C = cur[k];
+      if (C == 0) continue;
+
+      // Neighbors of every pixel of the word: West is column c-1, so the bits move up by 1.
+      // The word before the first word of a row is the empty word after the previous row
+      unsigned long long N = up[k];
+      unsigned long long S = down[k];
+      unsigned long long W = (C << 1) | (cur[k-1] >> 63);
+      unsigned long long E = (C >> 1) | (cur[k+1] << 63);
+      unsigned long long NW = (N << 1) | (up[k-1] >> 63);
+      unsigned long long NE = (N >> 1) | (up[k+1] << 63);
+      unsigned long long SW = (S << 1) | (down[k-1] >> 63);
+      unsigned long long SE = (S >> 1) | (down[k+1] << 63);
+
+      // Diagonal neighbors count only if both adjacent 4-neighbors are empty
+      NW &= ~(N | W);
+      NE &= ~(N | E);
+      SE &= ~(S | E);
+      SW &= ~(S | W);
+
+      // Pixels with exactly one neighbor
+      unsigned long long atLeast1 = N, atLeast2 = 0;
+      atLeast2 |= atLeast1 & S;  atLeast1 |= S;
+      atLeast2 |= atLeast1 & W;  atLeast1 |= W;
+      atLeast2 |= atLeast1 & E;  atLeast1 |= E;
+      atLeast2 |= atLeast1 & NW; atLeast1 |= NW;
+      atLeast2 |= atLeast1 & NE; atLeast1 |= NE;
+      atLeast2 |= atLeast1 & SE; atLeast1 |= SE;
+      atLeast2 |= atLeast1 & SW; atLeast1 |= SW;
+
+      unsigned long long tips = C & atLeast1 & ~atLeast2;
+      if (k == 0) tips &= ~3ULL;
+      if (64*k+64 > width-2) tips &= ~0ULL >> (64*k+64 - (width-2));
+
+      while (tips){
+        int gap = FillGaps2Pixel(strongBits, stride, i, 64*k + Ctz64(tips));
+        tips &= tips-1;
+        if (gap < 0) continue;
+
+        unsigned long long bit = 1ULL << (gap&63);
+        if ((edgels[gap>>6] & bit) == 0){edgels[gap>>6] |= bit; (*noGaps)++;}
+      } //end-while
+    } //end-for
+  } //end-for
+
+  int noEdgels = 0;
+  for (int k=0; k<height*wordsPerRow; k++) noEdgels += Popcount64(edgels[k]);
+
+  return noEdgels;
+} //end-FillGaps2Bitmap
+
+
+///======================================= Step 2: EdgeSegment Creation by 8 Directional Walk ======================================
+#define UP_LEFT    1   // diagonal
+#define UP         2   
+#define UP_RIGHT   3
+#define RIGHT      4
+#define DOWN_RIGHT 5
+#define DOWN       6
+#define DOWN_LEFT  7
+#define LEFT       8
+
+///-----------------------------------------------------------------------------------------------
+/// Next direction prediction engine (Use the last 8 directions to make a prediction for the next)
+/// A prediction compares how many of the queued directions vote for either of two options. The 6
+/// possible comparisons are kept up to date as directions are added & evicted, each in an 8 bit
+/// lane of a single word holding 16 + (# votes for the first option) - (# votes for the second).
+/// Bit 4 of a lane is then set iff the first option wins, so a prediction is a shift & a mask
+///
+
+// Lane of the comparison made for each analysis direction, and the two options of each lane
+static const int predictLane[9] = {0, 2, 1, 3, 0, 4, 1, 5, 0};
+static const int predictFirst[6]  = {LEFT,  UP,   UP,   UP,    DOWN,  DOWN};
+static const int predictSecond[6] = {RIGHT, DOWN, LEFT, RIGHT, RIGHT, LEFT};
+
+// Vote of each direction in each lane: +1 for the first option, -1 for the second, 0 if it does not count
+static const int predictVotes[6][9] = {
+//    -  UL  UP  UR   R  DR   D  DL   L
+  {0, +1,  0, -1, -1, -1,  0, +1, +1},   // LEFT or RIGHT
+  {0, +1, +1, +1,  0, -1, -1, -1,  0},   // UP or DOWN
+  {0,  0, +1,  0,  0,  0,  0,  0, -1},   // UP or LEFT
+  {0,  0, +1,  0, -1,  0,  0,  0,  0},   // UP or RIGHT
+  {0,  0,  0,  0, -1,  0, +1,  0,  0},   // DOWN or RIGHT
+  {0,  0,  0,  0,  0,  0, +1,  0, -1},   // DOWN or LEFT
+};
+
+struct PredictMasks {
+  unsigned long long plus[9], minus[9];   // Per direction votes packed into the lanes
+
+  PredictMasks(){
+    for (int dir=0; dir<9; dir++){
+      plus[dir] = minus[dir] = 0;
+
+      for (int lane=0; lane<6; lane++){
+        if      (predictVotes[lane][dir] > 0) plus[dir]  |= 1ULL << (8*lane);
+        else if (predictVotes[lane][dir] < 0) minus[dir] |= 1ULL << (8*lane);
+      } //end-for
+    } //end-for
+  } //end-PredictMasks
+};
+
+static const PredictMasks predictMasks;
+
+struct Queue {
+#define QSIZE 8
+  int Q[QSIZE];
+  int noItems;
+  int rear;
+  unsigned long long votes;   // 6 lanes of 16 + (# first) - (# second). Stays within [8, 24]
+
+  Queue(){noItems = 0; rear = 0; votes = 0x101010101010ULL;}
+
+  void Add(int dir){
+    if (noItems < QSIZE) noItems++;
+    else                 votes = votes + predictMasks.minus[Q[rear]] - predictMasks.plus[Q[rear]];  // Evict the oldest direction
+
+    votes = votes + predictMasks.plus[dir] - predictMasks.minus[dir];
+    Q[rear++] = dir;
+    if (rear >= QSIZE) rear = 0;
+  } //end-add
+
+  // 0 if the first option of the lane is predicted, 1 for the second
+  int Turn(int lane){
+    return (int)((votes >> (8*lane+4)) & 1) ^ 1;
+  } //end-Turn
+
+  int ComputeNextDir(int analysisDir){
+    int lane = predictLane[analysisDir];
+
+    return Turn(lane) ? predictSecond[lane] : predictFirst[lane];
+  } //end-ComputeNextDir
+};
+
+///----------------------------------------------------------------------------------------------------
+/// Feeds "dirs" to a Queue and stores its prediction for every analysis direction after each one
+///
+void PELPredictDirs(const int *dirs, int noDirs, int *nextDirs){
+  Queue Q;
+
+  for (int i=0; i<noDirs; i++){
+    Q.Add(dirs[i]);
+    for (int analysisDir=UP_LEFT; analysisDir<=LEFT; analysisDir++) nextDirs[8*i+analysisDir-1] = Q.ComputeNextDir(analysisDir);
+  } //end-for
+} //end-PELPredictDirs
+
+///----------------------------------------------------------------------------------------------------
+/// 8 Directional Walk with Prediction
+///
+template <class Edgels>
+static int Walk8Dirs(Edgels edgeImg, int width, int height, int stride, int r, int c, int dir, Pixel *pixels){
+  Queue Q;
+
+  int count = 0;
+
+  while (1){
+    edgeImg.Clear(r*stride+c);
+
+    if (r<=0 || r>=height-1) return count;
+    if (c<=0 || c>=width-1) return count;
+
+    pixels[count].r = r;
+    pixels[count].c = c;
+    count++;
+
+    // Add the current direction to the Q
+    Q.Add(dir);
+
+    if        (dir == UP_LEFT){
+      // Should we check UP or LEFT first?
+      int nextDir = Q.ComputeNextDir(UP_LEFT);
+
+      // Up-Left?
+      if (edgeImg[(r-1)*stride+c-1]){
+        if (nextDir == UP){
+          // Up?
+          if (edgeImg[(r-1)*stride+c]){
+            pixels[count].r = r-1; pixels[count].c = c; count++;
+            edgeImg.Clear((r-1)*stride+c);
+
+          // Left?
+          } else if (edgeImg[r*stride+c-1]){
+            pixels[count].r = r; pixels[count].c = c-1; count++;
+            edgeImg.Clear(r*stride+c-1);
+          } //end-else
+
+        } else {
+          // Left?
+          if (edgeImg[r*stride+c-1]){
+            pixels[count].r = r; pixels[count].c = c-1; count++;
+            edgeImg.Clear(r*stride+c-1);
+
+          // Up?
+          } else if (edgeImg[(r-1)*stride+c]){
+            pixels[count].r = r-1; pixels[count].c = c; count++;
+            edgeImg.Clear((r-1)*stride+c);
+          } //end-else
+        } //end-else
+
+        r--; c--; dir = UP_LEFT; continue;
+      } // end-if
+
+      if (nextDir == UP){
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
+
+        // Left
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
+
+        // Up-Right
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+
+        // Down-Left
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+
+        // Right
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
+
+        // Down
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+      } else {
+        // Left
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
+
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
+
+        // Down-Left
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+
+        // Up-Right
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+
+        // Down
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+        // Right
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
+      } //end-else
+
+      // Nowhere to go
+      return count;
+
+    } else if (dir == UP){
+      // Up
+      if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
+
+      // Should we check LEFT or RIGHT first?
       int nextDir = Q.ComputeNextDir(LEFT);
 
       if (nextDir == LEFT){
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){
-          if (edgeImg[r*width+c-1]){edgeImg[r*width+c-1] = 0; pixels[count].r = r; pixels[count].c = c-1; count++;}
+        if (edgeImg[(r-1)*stride+c-1]){
+          if (edgeImg[r*stride+c-1]){edgeImg.Clear(r*stride+c-1); pixels[count].r = r; pixels[count].c = c-1; count++;}
           r--; c--; dir = UP_LEFT; continue;
         } //end-if
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){
-          if (edgeImg[r*width+c+1]){edgeImg[r*width+c+1]= 0; pixels[count].r = r; pixels[count].c = c+1; count++;}
+        if (edgeImg[(r-1)*stride+c+1]){
+          if (edgeImg[r*stride+c+1]){edgeImg.Clear(r*stride+c+1); pixels[count].r = r; pixels[count].c = c+1; count++;}
           r--; c++; dir = UP_RIGHT; continue;
         } //end-if
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
 
       } else {
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){
-          if (edgeImg[r*width+c+1]){edgeImg[r*width+c+1]= 0; pixels[count].r = r; pixels[count].c = c+1; count++;}
+        if (edgeImg[(r-1)*stride+c+1]){
+          if (edgeImg[r*stride+c+1]){edgeImg.Clear(r*stride+c+1); pixels[count].r = r; pixels[count].c = c+1; count++;}
           r--; c++; dir = UP_RIGHT; continue;
         } //end-if
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){
-          if (edgeImg[r*width+c-1]){edgeImg[r*width+c-1] = 0; pixels[count].r = r; pixels[count].c = c-1; count++;}
+        if (edgeImg[(r-1)*stride+c-1]){
+          if (edgeImg[r*stride+c-1]){edgeImg.Clear(r*stride+c-1); pixels[count].r = r; pixels[count].c = c-1; count++;}
           r--; c--; dir = UP_LEFT; continue;
         } //end-if
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
       } //end-else
 
       // Nowhere to go
@@ -532,29 +1572,29 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
       int nextDir = Q.ComputeNextDir(UP_RIGHT);
 
       // Up-Right
-      if (edgeImg[(r-1)*width+c+1]){
+      if (edgeImg[(r-1)*stride+c+1]){
         if (nextDir == UP){
           // Up?
-          if (edgeImg[(r-1)*width+c]){
+          if (edgeImg[(r-1)*stride+c]){
             pixels[count].r = r-1; pixels[count].c = c; count++;
-            edgeImg[(r-1)*width+c] = 0;
+            edgeImg.Clear((r-1)*stride+c);
 
           // Right?
-          } else if (edgeImg[r*width+c+1]){
+          } else if (edgeImg[r*stride+c+1]){
             pixels[count].r = r; pixels[count].c = c+1; count++;
-            edgeImg[r*width+c+1] = 0;
+            edgeImg.Clear(r*stride+c+1);
           } //end-else
 
         } else {
           // Right?
-          if (edgeImg[r*width+c+1]){
+          if (edgeImg[r*stride+c+1]){
             pixels[count].r = r; pixels[count].c = c+1; count++;
-            edgeImg[r*width+c+1] = 0;
+            edgeImg.Clear(r*stride+c+1);
 
           // Up?
-          } else if (edgeImg[(r-1)*width+c]){
+          } else if (edgeImg[(r-1)*stride+c]){
             pixels[count].r = r-1; pixels[count].c = c; count++;
-            edgeImg[(r-1)*width+c] = 0;
+            edgeImg.Clear((r-1)*stride+c);
           } //end-else
         } //end-else
 
@@ -563,41 +1603,41 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
 
       if (nextDir == UP){
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
       } else {
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
 
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
       } //end-else
 
       // Nowhere to go
@@ -605,60 +1645,60 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
 
     } else if (dir == RIGHT){
       // Right
-      if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+      if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
       // Should we check UP or DOWN first?
       int nextDir = Q.ComputeNextDir(UP);
 
       if (nextDir == UP){
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){
-          if (edgeImg[(r-1)*width+c]){edgeImg[(r-1)*width+c]= 0; pixels[count].r = r-1; pixels[count].c = c; count++;}
+        if (edgeImg[(r-1)*stride+c+1]){
+          if (edgeImg[(r-1)*stride+c]){edgeImg.Clear((r-1)*stride+c); pixels[count].r = r-1; pixels[count].c = c; count++;}
           r--; c++; dir = UP_RIGHT; continue;
         } //end-if
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){
-          if (edgeImg[(r+1)*width+c]){edgeImg[(r+1)*width+c]= 0; pixels[count].r = r+1; pixels[count].c = c; count++;}
+        if (edgeImg[(r+1)*stride+c+1]){
+          if (edgeImg[(r+1)*stride+c]){edgeImg.Clear((r+1)*stride+c); pixels[count].r = r+1; pixels[count].c = c; count++;}
           r++; c++; dir = DOWN_RIGHT; continue;
         } //end-if
 
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
 
       } else {
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){
-          if (edgeImg[(r+1)*width+c]){edgeImg[(r+1)*width+c]= 0; pixels[count].r = r+1; pixels[count].c = c; count++;}
+        if (edgeImg[(r+1)*stride+c+1]){
+          if (edgeImg[(r+1)*stride+c]){edgeImg.Clear((r+1)*stride+c); pixels[count].r = r+1; pixels[count].c = c; count++;}
           r++; c++; dir = DOWN_RIGHT; continue;
         } //end-if
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){
-          if (edgeImg[(r-1)*width+c]){edgeImg[(r-1)*width+c]= 0; pixels[count].r = r-1; pixels[count].c = c; count++;}
+        if (edgeImg[(r-1)*stride+c+1]){
+          if (edgeImg[(r-1)*stride+c]){edgeImg.Clear((r-1)*stride+c); pixels[count].r = r-1; pixels[count].c = c; count++;}
           r--; c++; dir = UP_RIGHT; continue;
         } //end-if
 
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
       } //end-else
 
       // Nowhere to go
@@ -669,29 +1709,29 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
       int nextDir = Q.ComputeNextDir(DOWN_RIGHT);
 
       // Down-Right?
-      if (edgeImg[(r+1)*width+c+1]){
+      if (edgeImg[(r+1)*stride+c+1]){
         if (nextDir == DOWN){
           // Down?
-          if (edgeImg[(r+1)*width+c]){
+          if (edgeImg[(r+1)*stride+c]){
             pixels[count].r = r+1; pixels[count].c = c; count++;
-            edgeImg[(r+1)*width+c] = 0;
+            edgeImg.Clear((r+1)*stride+c);
 
           // Right?
-          } else if (edgeImg[r*width+c+1]){
+          } else if (edgeImg[r*stride+c+1]){
             pixels[count].r = r; pixels[count].c = c+1; count++;
-            edgeImg[r*width+c+1] = 0;
+            edgeImg.Clear(r*stride+c+1);
           } //end-else
 
         } else {
           // Right?
-          if (edgeImg[r*width+c+1]){
+          if (edgeImg[r*stride+c+1]){
             pixels[count].r = r; pixels[count].c = c+1; count++;
-            edgeImg[r*width+c+1] = 0;
+            edgeImg.Clear(r*stride+c+1);
 
           // Down?
-          } else if (edgeImg[(r+1)*width+c]){
+          } else if (edgeImg[(r+1)*stride+c]){
             pixels[count].r = r+1; pixels[count].c = c; count++;
-            edgeImg[(r+1)*width+c] = 0;
+            edgeImg.Clear((r+1)*stride+c);
           } //end-else
         } //end-else
 
@@ -700,41 +1740,41 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
 
       if (nextDir == DOWN){
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
       } else {
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
+        if (edgeImg[(r+1)*stride+c-1]){r++; c--; dir = DOWN_LEFT; continue;}
 
         // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
       } //end-else
 
       // Nowhere to go
@@ -742,60 +1782,60 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
 
     } else if (dir == DOWN){
       // Down
-      if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+      if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
 
       // Should we check LEFT or RIGHT first?
       int nextDir = Q.ComputeNextDir(LEFT);
 
       if (nextDir == LEFT){
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){
-          if (edgeImg[r*width+c-1]){edgeImg[r*width+c-1]= 0; pixels[count].r = r; pixels[count].c = c-1; count++;} 
+        if (edgeImg[(r+1)*stride+c-1]){
+          if (edgeImg[r*stride+c-1]){edgeImg.Clear(r*stride+c-1); pixels[count].r = r; pixels[count].c = c-1; count++;} 
           r++; c--; dir = DOWN_LEFT; continue;
         } //end-if
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){
-          if (edgeImg[r*width+c+1]){edgeImg[r*width+c+1] = 0; pixels[count].r = r; pixels[count].c = c+1; count++;} 
+        if (edgeImg[(r+1)*stride+c+1]){
+          if (edgeImg[r*stride+c+1]){edgeImg.Clear(r*stride+c+1); pixels[count].r = r; pixels[count].c = c+1; count++;} 
           r++; c++; dir = DOWN_RIGHT; continue;
         } //end-if
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
 
       } else {
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){
-          if (edgeImg[r*width+c+1]){edgeImg[r*width+c+1]= 0; pixels[count].r = r; pixels[count].c = c+1; count++;} 
+        if (edgeImg[(r+1)*stride+c+1]){
+          if (edgeImg[r*stride+c+1]){edgeImg.Clear(r*stride+c+1); pixels[count].r = r; pixels[count].c = c+1; count++;} 
           r++; c++; dir = DOWN_RIGHT; continue;
         } //end-if
 
         // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){
-          if (edgeImg[r*width+c-1]){edgeImg[r*width+c-1]= 0; pixels[count].r = r; pixels[count].c = c-1; count++;} 
+        if (edgeImg[(r+1)*stride+c-1]){
+          if (edgeImg[r*stride+c-1]){edgeImg.Clear(r*stride+c-1); pixels[count].r = r; pixels[count].c = c-1; count++;} 
           r++; c--; dir = DOWN_LEFT; continue;
         } //end-if
 
         // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
 
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
 
         // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
 
         // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
       } //end-else
 
       // Nowhere to go
@@ -806,29 +1846,29 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
       int nextDir = Q.ComputeNextDir(DOWN_LEFT);
 
       // Down-Left?
-      if (edgeImg[(r+1)*width+c-1]){
+      if (edgeImg[(r+1)*stride+c-1]){
         if (nextDir == DOWN){
           // Down?
-          if (edgeImg[(r+1)*width+c]){
+          if (edgeImg[(r+1)*stride+c]){
             pixels[count].r = r+1; pixels[count].c = c; count++;
-            edgeImg[(r+1)*width+c] = 0;
+            edgeImg.Clear((r+1)*stride+c);
 
           // Left?
-          } else if (edgeImg[r*width+c-1]){
+          } else if (edgeImg[r*stride+c-1]){
             pixels[count].r = r; pixels[count].c = c-1; count++;
-            edgeImg[r*width+c-1] = 0;
+            edgeImg.Clear(r*stride+c-1);
           } //end-else
 
         } else {
           // Left?
-          if (edgeImg[r*width+c-1]){
+          if (edgeImg[r*stride+c-1]){
             pixels[count].r = r; pixels[count].c = c-1; count++;
-            edgeImg[r*width+c-1] = 0;
+            edgeImg.Clear(r*stride+c-1);
 
           // Down?
-          } else if (edgeImg[(r+1)*width+c]){
+          } else if (edgeImg[(r+1)*stride+c]){
             pixels[count].r = r+1; pixels[count].c = c; count++;
-            edgeImg[(r+1)*width+c] = 0;
+            edgeImg.Clear((r+1)*stride+c);
           } //end-else
         } //end-else
 
@@ -837,223 +1877,1006 @@ static int Walk8Dirs(unsigned char *edgeImg, int width, int height, int r, int c
 
       if (nextDir == DOWN){
         // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+        // Left
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
+
+        // Down-Right
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+
+        // Up-Left
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
+
+        // Right
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
+
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
+      } else {
         // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+        if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
+
+        // Down
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+        // Up-Left
+        if (edgeImg[(r-1)*stride+c-1]){r--; c--; dir = UP_LEFT; continue;}
+
+        // Down-Right
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
+
+        // Right
+        if (edgeImg[r*stride+c+1]){c++; dir = RIGHT; continue;}
+      } //end-else
+      // Nowhere to go
+      return count;
+
+    } else { // (dir == LEFT){
+      // Left
+      if (edgeImg[r*stride+c-1]){c--; dir = LEFT; continue;}
+
+      // Should we check UP or DOWN first?
+      int nextDir = Q.ComputeNextDir(UP);
+
+      if (nextDir == UP){
+        // Up-Left
+        if (edgeImg[(r-1)*stride+c-1]){
+          if (edgeImg[(r-1)*stride+c]){edgeImg.Clear((r-1)*stride+c); pixels[count].r = r-1; pixels[count].c = c; count++;}
+          r--; c--; dir = UP_LEFT; continue;
+        } //end-if
+
+        // Down-Left
+        if (edgeImg[(r+1)*stride+c-1]){
+          if (edgeImg[(r+1)*stride+c]){edgeImg.Clear((r+1)*stride+c); pixels[count].r = r+1; pixels[count].c = c; count++;}
+          r++; c--; dir = DOWN_LEFT; continue;
+        } //end-if
+
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
+
+        // Down
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+        // Up-Right
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+
+        // Down-Right
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+
+      } else {
+        // Down-Left
+        if (edgeImg[(r+1)*stride+c-1]){
+          if (edgeImg[(r+1)*stride+c]){edgeImg.Clear((r+1)*stride+c); pixels[count].r = r+1; pixels[count].c = c; count++;}
+          r++; c--; dir = DOWN_LEFT; continue;
+        } //end-if
+
+        // Up-Left
+        if (edgeImg[(r-1)*stride+c-1]){
+          if (edgeImg[(r-1)*stride+c]){edgeImg.Clear((r-1)*stride+c); pixels[count].r = r-1; pixels[count].c = c; count++;}
+          r--; c--; dir = UP_LEFT; continue;
+        } //end-if
+
+        // Down
+        if (edgeImg[(r+1)*stride+c]){r++; dir = DOWN; continue;}
+
+        // Up
+        if (edgeImg[(r-1)*stride+c]){r--; dir = UP; continue;}
 
         // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+        if (edgeImg[(r+1)*stride+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+
+        // Up-Right
+        if (edgeImg[(r-1)*stride+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+      } //end-else
+
+      // Nowhere to go
+      return count;
+    } // end-else
+  } //end-while
+
+  return count;
+} //end-Walk8Dirs
+
+///----------------------------------------------------------------------------------------------------
+/// Table-driven 8 Directional Walk with Prediction
+/// Walk8Dirs probes the neighbors of the current pixel in an order fixed by the current direction &
+/// the predicted turn. Here these orders are encoded in a table indexed by the direction, the turn
+/// & the 8-neighbor occupancy mask of the pixel, giving the next move directly. The chains are
+/// identical to those of Walk8Dirs
+///
+
+// Row & column offsets of the directions, and their bits in the 8-neighbor occupancy mask
+static const int dirR[9] = {0, -1, -1, -1,  0,  1,  1,  1,  0};
+static const int dirC[9] = {0, -1,  0,  1,  1,  1,  0, -1, -1};
+#define DIR_BIT(dir) (1 << ((dir)-1))
+
+// Prediction lane of each direction (the lane of the direction Walk8Dirs gives ComputeNextDir)
+static const int walkLane[9] = {0, 2, 0, 3, 1, 4, 0, 5, 1};
+
+// Probe orders of Walk8Dirs for the two turns of the lane: {move, extra1, extra2}. When moving, the
+// first of the extra pixels that is set is also added to the chain (a corner cut by a diagonal move)
+static const signed char walkProbes[9][2][7][3] = {
+  {{{0}}},
+  // UP_LEFT
+  {{{UP_LEFT, UP, LEFT}, {UP}, {LEFT}, {UP_RIGHT}, {DOWN_LEFT}, {RIGHT}, {DOWN}},
+   {{UP_LEFT, LEFT, UP}, {LEFT}, {UP}, {DOWN_LEFT}, {UP_RIGHT}, {DOWN}, {RIGHT}}},
+  // UP
+  {{{UP}, {UP_LEFT, LEFT}, {UP_RIGHT, RIGHT}, {LEFT}, {RIGHT}, {DOWN_LEFT}, {DOWN_RIGHT}},
+   {{UP}, {UP_RIGHT, RIGHT}, {UP_LEFT, LEFT}, {RIGHT}, {LEFT}, {DOWN_RIGHT}, {DOWN_LEFT}}},
+  // UP_RIGHT
+  {{{UP_RIGHT, UP, RIGHT}, {UP}, {RIGHT}, {UP_LEFT}, {DOWN_RIGHT}, {LEFT}, {DOWN}},
+   {{UP_RIGHT, RIGHT, UP}, {RIGHT}, {UP}, {DOWN_RIGHT}, {UP_LEFT}, {DOWN}, {LEFT}}},
+  // RIGHT
+  {{{RIGHT}, {UP_RIGHT, UP}, {DOWN_RIGHT, DOWN}, {UP}, {DOWN}, {UP_LEFT}, {DOWN_LEFT}},
+   {{RIGHT}, {DOWN_RIGHT, DOWN}, {UP_RIGHT, UP}, {DOWN}, {UP}, {DOWN_LEFT}, {UP_LEFT}}},
+  // DOWN_RIGHT
+  {{{DOWN_RIGHT, DOWN, RIGHT}, {DOWN}, {RIGHT}, {DOWN_LEFT}, {UP_RIGHT}, {LEFT}, {UP}},
+   {{DOWN_RIGHT, RIGHT, DOWN}, {RIGHT}, {DOWN}, {UP_RIGHT}, {DOWN_LEFT}, {UP}, {LEFT}}},
+  // DOWN
+  {{{DOWN}, {DOWN_LEFT, LEFT}, {DOWN_RIGHT, RIGHT}, {LEFT}, {RIGHT}, {UP_LEFT}, {UP_RIGHT}},
+   {{DOWN}, {DOWN_RIGHT, RIGHT}, {DOWN_LEFT, LEFT}, {RIGHT}, {LEFT}, {UP_RIGHT}, {UP_LEFT}}},
+  // DOWN_LEFT
+  {{{DOWN_LEFT, DOWN, LEFT}, {DOWN}, {LEFT}, {DOWN_RIGHT}, {UP_LEFT}, {RIGHT}, {UP}},
+   {{DOWN_LEFT, LEFT, DOWN}, {LEFT}, {DOWN}, {UP_LEFT}, {DOWN_RIGHT}, {UP}, {RIGHT}}},
+  // LEFT
+  {{{LEFT}, {UP_LEFT, UP}, {DOWN_LEFT, DOWN}, {UP}, {DOWN}, {UP_RIGHT}, {DOWN_RIGHT}},
+   {{LEFT}, {DOWN_LEFT, DOWN}, {UP_LEFT, UP}, {DOWN}, {UP}, {DOWN_RIGHT}, {UP_RIGHT}}},
+};
+
+///----------------------------------------------------------------------------------------------------
+/// Next move table: walkTable[dir][turn][mask] = move | (extra << 4), 0 if there is nowhere to go
+///
+struct WalkTable {
+  unsigned char moves[9][2][256];
+
+  WalkTable(){
+    memset(moves, 0, sizeof(moves));
+
+    for (int dir=1; dir<=8; dir++){
+      for (int turn=0; turn<2; turn++){
+        for (int mask=0; mask<256; mask++){
+          for (int k=0; k<7; k++){
+            const signed char *probe = walkProbes[dir][turn][k];
+            if ((mask & DIR_BIT(probe[0])) == 0) continue;
+
+            int extra = 0;
+            if      (probe[1] && (mask & DIR_BIT(probe[1]))) extra = probe[1];
+            else if (probe[2] && (mask & DIR_BIT(probe[2]))) extra = probe[2];
+
+            moves[dir][turn][mask] = (unsigned char)(probe[0] | (extra << 4));
+            break;
+          } //end-for
+        } //end-for
+      } //end-for
+    } //end-for
+  } //end-WalkTable
+};
+
+static const WalkTable walkTable;
+
+template <class Edgels>
+static int Walk8DirsTable(Edgels edgeImg, int width, int height, int stride, int r, int c, int dir, Pixel *pixels){
+  Queue Q;
+
+  int count = 0;
+
+  while (1){
+    int p = r*stride + c;
+    edgeImg.Clear(p);
+
+    if (r<=0 || r>=height-1) return count;
+    if (c<=0 || c>=width-1) return count;
+
+    pixels[count].r = r;
+    pixels[count].c = c;
+    count++;
+
+    // Add the current direction to the Q
+    Q.Add(dir);
+
+    int move;
+    if (dir & 1){
+      // Diagonal directions
+      int mask = (edgeImg[p-stride-1] != 0)      | ((edgeImg[p-stride] != 0) << 1) | ((edgeImg[p-stride+1] != 0) << 2) | ((edgeImg[p+1] != 0) << 3) |
+                 ((edgeImg[p+stride+1] != 0) << 4) | ((edgeImg[p+stride] != 0) << 5) | ((edgeImg[p+stride-1] != 0) << 6)   | ((edgeImg[p-1] != 0) << 7);
+
+      int turn = Q.Turn(walkLane[dir]);
+      move = walkTable.moves[dir][turn][mask];
+
+    } else if (edgeImg[p+dirR[dir]*stride + dirC[dir]]){
+      // Straight ahead is always probed first
+      move = dir;
+
+    } else {
+      int mask = (edgeImg[p-stride-1] != 0)      | ((edgeImg[p-stride] != 0) << 1) | ((edgeImg[p-stride+1] != 0) << 2) | ((edgeImg[p+1] != 0) << 3) |
+                 ((edgeImg[p+stride+1] != 0) << 4) | ((edgeImg[p+stride] != 0) << 5) | ((edgeImg[p+stride-1] != 0) << 6)   | ((edgeImg[p-1] != 0) << 7);
+
+      int turn = Q.Turn(walkLane[dir]);
+      move = walkTable.moves[dir][turn][mask];
+    } //end-else
+
+    // Nowhere to go
+    if (move == 0) return count;
+
+    int extra = move >> 4;
+    if (extra){
+      int er = r + dirR[extra];
+      int ec = c + dirC[extra];
+
+      pixels[count].r = er; pixels[count].c = ec; count++;
+      edgeImg.Clear(er*stride+ec);
+    } //end-if
+
+    dir = move & 15;
+    r += dirR[dir];
+    c += dirC[dir];
+  } //end-while
+} //end-Walk8DirsTable
+
+///----------------------------------------------------------------------------------
+/// Returns the first column >= c of row r that may hold an edgel according to the index.
+/// Without an index every column is visited
+///
+static inline int NextAnchorColumn(const EdgelIndex *index, int r, int c, int width){
+  if (index == NULL) return c;
+  if (index->bits[r*index->wordsPerRow + (c>>9)] & (1ULL << ((c>>3) & 63))) return c;
+
+  int b = index->NextBlock(r, (c>>3)+1);
+  return b < 0 ? width : 8*b;
+} //end-NextAnchorColumn
+
+template <class Edgels>
+static inline int NextAnchorColumn(Edgels, const EdgelIndex *index, int r, int c, int width, int){
+  return NextAnchorColumn(index, r, c, width);
+} //end-NextAnchorColumn
+
+///----------------------------------------------------------------------------------
+/// On a bitmap the first edgel >= c of row r is found 64 columns at a time. Returns width if none
+///
+static inline int NextAnchorColumn(BitEdgels edgeImg, const EdgelIndex *, int r, int c, int width, int stride){
+  int k = (r*stride + c) >> 6;
+  int last = (r*stride + width-1) >> 6;
+  unsigned long long bits = edgeImg.words[k] & (~0ULL << (c&63));
+
+  while (bits == 0){
+    if (++k > last) return width;
+    bits = edgeImg.words[k];
+  } //end-while
+
+  return 64*k + Ctz64(bits) - r*stride;
+} //end-NextAnchorColumn
+
+///----------------------------------------------------------------------------------
+/// Predictive edge walk using 8 directions. If an edgel index is given, only its blocks are visited
+///
+template <class Edgels>
+static void PELWalk8Dirs(Edgels edgeImg, int width, int height, int stride, int MIN_SEGMENT_LEN, EdgeMap *map, Pixel *pixels, const EdgelIndex *index, WalkFunc<Edgels> walk){
+  int noSegments = 0;
+  int totalLen = 0;
+
+  // Go over the anchors in sorted order
+  for (int i=1; i<height-1; i++){
+    for (int j=NextAnchorColumn(edgeImg, index, i, 1, width, stride); j<width-1; j=NextAnchorColumn(edgeImg, index, i, j+1, width, stride)){
+      if (edgeImg[i*stride+j] == 0) continue;
+
+#if 0
+      int dir1, dir2;
+      dir1 = dir2 = -1;
+
+      // 8 directions
+      if      (edgeImg[i*stride+j+1]){dir1 = RIGHT; dir2 = LEFT;}
+      else if (edgeImg[(i+1)*stride+j]){dir1 = DOWN; dir2 = UP;}
+
+      else if (edgeImg[(i+1)*stride+j-1]){dir1 = DOWN_LEFT; dir2 = UP_RIGHT;}
+      else if (edgeImg[(i+1)*stride+j+1]){dir1 = DOWN_RIGHT; dir2 = UP_LEFT;}
+
+      // Skip single pixel edgels
+      if (dir1 < 0){edgeImg.Clear(i*stride+j); continue;}
+
+      // Walk using 8 directions
+      int len1 = walk(edgeImg, width, height, stride, i, j, dir1, pixels);
+      int len2 = walk(edgeImg, width, height, stride, i, j, dir2, pixels+len1);
+
+      if (len1+len2-1 < MIN_SEGMENT_LEN) continue;
+
+      map->segments[noSegments].pixels = map->pixels+totalLen;
+      int len = 0;
+      for (int k=len1-1; k>=1; k--){
+        map->segments[noSegments].pixels[len] = pixels[k];
+        len++;
+      } //end-for
+
+      for (int k=len1; k<len1+len2; k++){
+        map->segments[noSegments].pixels[len] = pixels[k];
+        len++;
+      } //end-for
+
+      map->segments[noSegments].noPixels = len;
+      noSegments++;
+      totalLen += len;
+    } //end-for
+  } // end-for
+#else
+      int dir1, dir2;
+      dir1 = dir2 = -1;
+
+      // 8 directions
+      if      (edgeImg[i*stride+j+1]) dir1 = RIGHT;
+      else if (edgeImg[(i+1)*stride+j]) dir1 = DOWN;
+
+      else if (edgeImg[(i+1)*stride+j-1]) dir1 = DOWN_LEFT;
+      else if (edgeImg[(i+1)*stride+j+1]) dir1 = DOWN_RIGHT;
+
+      // Skip single pixel edgels
+      if (dir1 < 0){edgeImg.Clear(i*stride+j); continue;}
+
+      // Walk using 8 directions
+      int len1 = walk(edgeImg, width, height, stride, i, j, dir1, pixels);
+    
+      int sr, sc;
+      if      (edgeImg[i*stride+j+1]){dir2 = RIGHT; sr = i; sc = j+1;}
+      else if (edgeImg[(i+1)*stride+j]){dir2 = DOWN; sr = i+1; sc = j;}
+
+      else if (edgeImg[(i+1)*stride+j-1]){dir2 = DOWN_LEFT; sr = i+1; sc = j-1;}
+      else if (edgeImg[(i+1)*stride+j+1]){dir2 = DOWN_RIGHT; sr = i+1; sc = j+1;}
+
+      int len2=0;
+      if (dir2 > 0) len2 = walk(edgeImg, width, height, stride, sr, sc, dir2, pixels+len1);
+
+      if (len1+len2 < MIN_SEGMENT_LEN) continue;
+
+      map->segments[noSegments].pixels = map->pixels+totalLen;
+      int len = 0;
+      for (int k=len1-1; k>=0; k--){
+        map->segments[noSegments].pixels[len] = pixels[k];
+        len++;
+      } //end-for
+
+      for (int k=len1; k<len1+len2; k++){
+        map->segments[noSegments].pixels[len] = pixels[k];
+        len++;
+      } //end-for
+
+      map->segments[noSegments].noPixels = len;
+      noSegments++;
+      totalLen += len;
+    } //end-for
+  } // end-for
+#endif
+
+
+  map->noSegments = noSegments;
+} // end-PELWalk8Dirs
+
+///======================== Step 2 (parallel): Tiled 8 Directional Walk ==========================
+#define MAX_WALK_THREADS 64
+
+// How the serial pass of the tiled walk takes a chain walked by a band (WalkChain::state)
+#define CHAIN_PENDING  0     // Not reached yet, & nothing the chain read has changed
+#define CHAIN_INVALID  1     // Not reached yet, but a pixel the chain read differs from what its band saw
+#define CHAIN_ACCEPTED 2     // Taken as it is
+#define CHAIN_REDONE   3     // Walked again from its anchor on the edge map
+
+///----------------------------------------------------------------------------------
+/// The private copy of a band: Records the chain that clears each edgel in "owners"
+///
+struct BandEdgels {
+  unsigned char *img;
+  int *owners;             // Owners of the pixels of the copy
+  int chain;               // Chain being walked
+
+  int operator[](int o) const {return img[o];}
+  void Clear(int o) const {img[o] = 0; owners[o] = chain;}
+};
+
+///----------------------------------------------------------------------------------
+/// One horizontal band of the image walked by its own thread
+///
+struct WalkBand {
+  int r0, r1;              // Band covers the image rows [r0, r1)
+  unsigned char *img;      // Private copy of the rows [r0-1, r1] (first & last rows are halos)
+  int noEdgels;            // # of edgels of the private copy
+  bool useWalkTable;       // Walk with Walk8DirsTable
+
+  Pixel *scratch;          // Chain buffer of Walk8Dirs
+  Pixel *pixels;           // Chain pixels (image coordinates)
+  WalkChain *chains;       // Chains of the band in the order of their anchors
+  int noChains;
+};
+
+///----------------------------------------------------------------------------------
+/// Copy row r of the edgels into a band as an edge map
+///
+template <class Edgels>
+static void CopyWalkRow(unsigned char *dst, Edgels edgeImg, int width, int stride, int r){
+  for (int j=0; j<width; j++) dst[j] = edgeImg[r*stride+j] ? 255 : 0;
+} //end-CopyWalkRow
+
+static void CopyWalkRow(unsigned char *dst, EdgelImage edgeImg, int width, int stride, int r){
+  memcpy(dst, edgeImg.img + r*stride, width);
+} //end-CopyWalkRow
+
+///----------------------------------------------------------------------------------
+/// Copy the rows of a band into its private buffer. The halo rows are the image borders
+/// for the first & last bands, and empty otherwise, so no walk leaves its band. The rows
+/// are also copied into "copy", the edge map of the serial pass, & their owners are reset
+///
+template <class Edgels>
+static void CopyWalkBand(WalkBand *band, Edgels edgeImg, int width, int height, int stride, unsigned char *copy, int *owners){
+  int noRows = band->r1 - band->r0;
+  int first = band->r0, last = band->r1;   // Rows of the image held by the band
+
+  if (band->r0 == 1){CopyWalkRow(band->img, edgeImg, width, stride, 0); first = 0;}
+  else              memset(band->img, 0, width);
+
+  if (band->r1 == height-1){CopyWalkRow(band->img + (noRows+1)*width, edgeImg, width, stride, height-1); last = height;}
+  else                     memset(band->img + (noRows+1)*width, 0, width);
+
+  for (int i=0; i<noRows; i++) CopyWalkRow(band->img + (i+1)*width, edgeImg, width, stride, band->r0+i);
+
+  memcpy(copy + first*width, band->img + (first-band->r0+1)*width, (last-first)*width);
+  for (int i=first*width; i<last*width; i++) owners[i] = -1;
+
+  // The walks may enter the image border rows in the halos, so their edgels are counted too
+  int noEdgels = 0;
+  for (int i=0; i<(noRows+2)*width; i++) if (band->img[i]) noEdgels++;
+  band->noEdgels = noEdgels;
+} //end-CopyWalkBand
+
+///----------------------------------------------------------------------------------
+/// Walk the chains of a band as PELWalk8Dirs does, but keep all of them regardless of their
+/// length, along with the single pixel edgels: The serial pass decides which ones are kept.
+/// The chain that clears each pixel is recorded in "owners", numbered from the first of "chains"
+///
+static void WalkBandChains(WalkBand *band, int width, int *owners, WalkChain *chains){
+  unsigned char *edgeImg = band->img;
+  BandEdgels edgels = {band->img, owners + (band->r0-1)*width, 0};
+  int height = band->r1 - band->r0 + 2;
+  int rowOffset = band->r0 - 1;
+  WalkFunc<BandEdgels> walk = band->useWalkTable ? Walk8DirsTable<BandEdgels> : Walk8Dirs<BandEdgels>;
+
+  Pixel *pixels = band->scratch;
+  int noChains = 0;
+  int totalLen = 0;
+
+  for (int i=1; i<height-1; i++){
+    for (int j=1; j<width-1; j++){
+      if (edgeImg[i*width+j] == 0) continue;
+
+      WalkChain *chain = &band->chains[noChains];
+      edgels.chain = (int)(chain - chains);
+      noChains++;
+
+      int dir1, dir2;
+      dir1 = dir2 = -1;
+
+      // 8 directions
+      if      (edgeImg[i*width+j+1]) dir1 = RIGHT;
+      else if (edgeImg[(i+1)*width+j]) dir1 = DOWN;
+
+      else if (edgeImg[(i+1)*width+j-1]) dir1 = DOWN_LEFT;
+      else if (edgeImg[(i+1)*width+j+1]) dir1 = DOWN_RIGHT;
+
+      int len1, len2 = 0;
+
+      if (dir1 < 0){
+        // A single pixel edgel
+        edgels.Clear(i*width+j);
+        pixels[0].r = i; pixels[0].c = j;
+        len1 = 1;
+
+      } else {
+        // Walk using 8 directions
+        len1 = walk(edgels, width, height, width, i, j, dir1, pixels);
+
+        int sr, sc;
+        if      (edgeImg[i*width+j+1]){dir2 = RIGHT; sr = i; sc = j+1;}
+        else if (edgeImg[(i+1)*width+j]){dir2 = DOWN; sr = i+1; sc = j;}
+
+        else if (edgeImg[(i+1)*width+j-1]){dir2 = DOWN_LEFT; sr = i+1; sc = j-1;}
+        else if (edgeImg[(i+1)*width+j+1]){dir2 = DOWN_RIGHT; sr = i+1; sc = j+1;}
+
+        if (dir2 > 0) len2 = walk(edgels, width, height, width, sr, sc, dir2, pixels+len1);
+      } //end-else
+
+      chain->pixels = band->pixels + totalLen;
+      chain->anchor = (i+rowOffset)*width + j;
+      chain->walked = dir1 >= 0;
+      chain->state = CHAIN_PENDING;
+
+      int len = 0;
+      for (int k=len1-1; k>=0; k--){
+        chain->pixels[len].r = pixels[k].r + rowOffset;
+        chain->pixels[len].c = pixels[k].c;
+        len++;
+      } //end-for
+
+      for (int k=len1; k<len1+len2; k++){
+        chain->pixels[len].r = pixels[k].r + rowOffset;
+        chain->pixels[len].c = pixels[k].c;
+        len++;
+      } //end-for
+
+      chain->noPixels = len;
+      totalLen += len;
+    } //end-for
+  } //end-for
+
+  band->noChains = noChains;
+} //end-WalkBandChains
+
+///----------------------------------------------------------------------------------
+/// Persistent threads of the tiled walk: Worker i runs band i+1 of each job & band 0 runs on
+/// the caller's thread. The workers are started by the first walk that needs them and wait
+/// for the next job in between, so the walks of the following frames start no threads
+///
+struct WalkWorkers {
+  std::thread threads[MAX_WALK_THREADS];
+  int noThreads;                // # of workers started
+
+  std::mutex lock;
+  std::condition_variable start, done;
+  int jobNo;                    // # of the current job. The workers wait for it to change
+  WalkBand *bands;              // Bands of the current job
+  int noBands;
+  void (*func)(void *arg, WalkBand *band);
+  void *arg;
+  int noRunning;                // # of workers still running the current job
+  bool quit;
+
+  WalkWorkers(){noThreads = 0; jobNo = 0; bands = NULL; noBands = 0; func = NULL; arg = NULL; noRunning = 0; quit = false;}
+};
+
+static void RunWalkWorker(WalkWorkers *workers, int id, int jobNo){
+  std::unique_lock<std::mutex> guard(workers->lock);
+
+  while (1){
+    while (workers->jobNo == jobNo && !workers->quit) workers->start.wait(guard);
+    if (workers->quit) return;
+
+    jobNo = workers->jobNo;
+    if (id+1 >= workers->noBands) continue;
+
+    guard.unlock();
+    workers->func(workers->arg, &workers->bands[id+1]);
+    guard.lock();
+
+    if (--workers->noRunning == 0) workers->done.notify_one();
+  } //end-while
+} //end-RunWalkWorker
+
+static void DeleteWalkWorkers(WalkWorkers *workers){
+  if (workers == NULL) return;
+
+  {
+    std::lock_guard<std::mutex> guard(workers->lock);
+    workers->quit = true;
+  }
+
+  workers->start.notify_all();
+  for (int i=0; i<workers->noThreads; i++) workers->threads[i].join();
+  delete workers;
+} //end-DeleteWalkWorkers
+
+template <class Func>
+static void CallOnBand(void *arg, WalkBand *band){
+  (*(Func *)arg)(band);
+} //end-CallOnBand
+
+///----------------------------------------------------------------------------------
+/// Run "func" on every band, each on a worker of the context
+///
+template <class Func>
+static void RunOnBands(PELContext *ctx, WalkBand *bands, int noBands, Func func){
+  if (ctx->walkWorkers == NULL) ctx->walkWorkers = new WalkWorkers();
+  WalkWorkers *workers = ctx->walkWorkers;
+
+  // Start the workers missing. No job is running, so they wait for the next one
+  for (; workers->noThreads < noBands-1; workers->noThreads++){
+    workers->threads[workers->noThreads] = std::thread(RunWalkWorker, workers, workers->noThreads, workers->jobNo);
+  } //end-for
+
+  {
+    std::lock_guard<std::mutex> guard(workers->lock);
+    workers->bands = bands;
+    workers->noBands = noBands;
+    workers->func = CallOnBand<Func>;
+    workers->arg = &func;
+    workers->noRunning = noBands-1;
+    workers->jobNo++;
+  }
+
+  workers->start.notify_all();
+  func(&bands[0]);
+
+  std::unique_lock<std::mutex> guard(workers->lock);
+  while (workers->noRunning > 0) workers->done.wait(guard);
+} //end-RunOnBands
+
+///----------------------------------------------------------------------------------
+/// State of the serial pass of the tiled walk over the whole edge map
+///
+struct WalkReplay {
+  unsigned char *img;      // Copy of the edge map. Only the edgels walked again are cleared in it
+  int *owners;             // Chain of the bands that cleared each pixel, -1 if none
+  WalkChain *chains;
+  int width, height;
+
+  int *anchors;            // Min-heap of the edgels left by the chains walked again
+  int noAnchors;
+};
+
+///----------------------------------------------------------------------------------
+/// Marks the chains up to "last" not reached yet that read pixel o as invalid: The pixel differs
+/// from what their band saw. A chain reads the 8 neighbors of its pixels only, which are still
+/// there unless the chain is invalid already
+///
+static void InvalidateReaders(WalkReplay *replay, int o, int last){
+  int width = replay->width;
+  int r = o / width;
+  int c = o % width;
+
+  for (int i=r-1; i<=r+1; i++){
+    if (i < 0 || i >= replay->height) continue;
+
+    for (int j=c-1; j<=c+1; j++){
+      if (j < 0 || j >= width || replay->img[i*width+j] == 0) continue;
+
+      int owner = replay->owners[i*width+j];
+      if (owner >= 0 && owner <= last && replay->chains[owner].state == CHAIN_PENDING) replay->chains[owner].state = CHAIN_INVALID;
+    } //end-for
+  } //end-for
+} //end-InvalidateReaders
+
+///----------------------------------------------------------------------------------
+/// The edge map as the serial walk sees it: The edgels of the accepted chains are gone
+///
+struct ReplayEdgels {
+  WalkReplay *replay;
+
+  int operator[](int o) const {
+    int owner = replay->owners[o];
+    return replay->img[o] && (owner < 0 || replay->chains[owner].state != CHAIN_ACCEPTED);
+  } //end-operator[]
+
+  void Clear(int o) const {
+    replay->img[o] = 0;
+
+    // The band saw the edgel until its chain cleared it, unless that chain was walked again. So
+    // the chains of the band up to that one saw it, & no other chain if it is another band's
+    int owner = replay->owners[o];
+    if (owner < 0)                                         InvalidateReaders(replay, o, INT_MAX);
+    else if (replay->chains[owner].state != CHAIN_REDONE) InvalidateReaders(replay, o, owner);
+  } //end-Clear
+};
+
+static void PushAnchor(WalkReplay *replay, int o){
+  int *heap = replay->anchors;
+  int k = replay->noAnchors++;
+
+  while (k > 0 && heap[(k-1)/2] > o){
+    heap[k] = heap[(k-1)/2];
+    k = (k-1)/2;
+  } //end-while
+
+  heap[k] = o;
+} //end-PushAnchor
 
-        // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+static int PopAnchor(WalkReplay *replay){
+  int *heap = replay->anchors;
+  int top = heap[0];
+  int o = heap[--replay->noAnchors];
+  int n = replay->noAnchors;
 
-        // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
+  int k = 0;
+  while (2*k+1 < n){
+    int child = 2*k+1;
+    if (child+1 < n && heap[child+1] < heap[child]) child++;
+    if (heap[child] >= o) break;
 
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+    heap[k] = heap[child];
+    k = child;
+  } //end-while
 
-      } else {
-        // Left
-        if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+  if (n > 0) heap[k] = o;
+  return top;
+} //end-PopAnchor
 
-        // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+///----------------------------------------------------------------------------------
+/// The band of a chain saw empty rows above & below it, as a walk must not leave its band.
+/// Invalidates the chains on row "bandRow" next to the edgels of the adjacent row "haloRow"
+///
+static void InvalidateHaloReaders(WalkReplay *replay, int haloRow, int bandRow){
+  ReplayEdgels edgels = {replay};
+  int width = replay->width;
 
-        // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){r--; c--; dir = UP_LEFT; continue;}
+  for (int c=0; c<width; c++){
+    if (edgels[haloRow*width+c] == 0) continue;
 
-        // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+    for (int j=c-1; j<=c+1; j++){
+      if (j < 0 || j >= width) continue;
 
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+      int owner = replay->owners[bandRow*width+j];
+      if (owner >= 0 && replay->chains[owner].state == CHAIN_PENDING) replay->chains[owner].state = CHAIN_INVALID;
+    } //end-for
+  } //end-for
+} //end-InvalidateHaloReaders
 
-        // Right
-        if (edgeImg[r*width+c+1]){c++; dir = RIGHT; continue;}
-      } //end-else
-      // Nowhere to go
-      return count;
+///----------------------------------------------------------------------------------
+/// Walk from anchor o as PELWalk8Dirs does & add the chain to "map" if it is long enough
+///
+static void ReplayAnchor(WalkReplay *replay, int o, EdgeMap *map, int *totalLen, Pixel *pixels, int MIN_SEGMENT_LEN, WalkFunc<ReplayEdgels> walk){
+  ReplayEdgels edgeImg = {replay};
+  int width = replay->width;
+  int height = replay->height;
+  int i = o / width;
+  int j = o % width;
 
-    } else { // (dir == LEFT){
-      // Left
-      if (edgeImg[r*width+c-1]){c--; dir = LEFT; continue;}
+  int dir1, dir2;
+  dir1 = dir2 = -1;
 
-      // Should we check UP or DOWN first?
-      int nextDir = Q.ComputeNextDir(UP);
+  // 8 directions
+  if      (edgeImg[i*width+j+1]) dir1 = RIGHT;
+  else if (edgeImg[(i+1)*width+j]) dir1 = DOWN;
 
-      if (nextDir == UP){
-        // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){
-          if (edgeImg[(r-1)*width+c]){edgeImg[(r-1)*width+c]= 0; pixels[count].r = r-1; pixels[count].c = c; count++;}
-          r--; c--; dir = UP_LEFT; continue;
-        } //end-if
+  else if (edgeImg[(i+1)*width+j-1]) dir1 = DOWN_LEFT;
+  else if (edgeImg[(i+1)*width+j+1]) dir1 = DOWN_RIGHT;
 
-        // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){
-          if (edgeImg[(r+1)*width+c]){edgeImg[(r+1)*width+c] = 0; pixels[count].r = r+1; pixels[count].c = c; count++;}
-          r++; c--; dir = DOWN_LEFT; continue;
-        } //end-if
+  // Skip single pixel edgels
+  if (dir1 < 0){edgeImg.Clear(o); return;}
 
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+  // Walk using 8 directions
+  int len1 = walk(edgeImg, width, height, width, i, j, dir1, pixels);
 
-        // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+  int sr, sc;
+  if      (edgeImg[i*width+j+1]){dir2 = RIGHT; sr = i; sc = j+1;}
+  else if (edgeImg[(i+1)*width+j]){dir2 = DOWN; sr = i+1; sc = j;}
 
-        // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
+  else if (edgeImg[(i+1)*width+j-1]){dir2 = DOWN_LEFT; sr = i+1; sc = j-1;}
+  else if (edgeImg[(i+1)*width+j+1]){dir2 = DOWN_RIGHT; sr = i+1; sc = j+1;}
 
-        // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+  int len2 = 0;
+  if (dir2 > 0) len2 = walk(edgeImg, width, height, width, sr, sc, dir2, pixels+len1);
 
-      } else {
-        // Down-Left
-        if (edgeImg[(r+1)*width+c-1]){
-          if (edgeImg[(r+1)*width+c]){edgeImg[(r+1)*width+c] = 0; pixels[count].r = r+1; pixels[count].c = c; count++;}
-          r++; c--; dir = DOWN_LEFT; continue;
-        } //end-if
+  if (len1+len2 < MIN_SEGMENT_LEN) return;
 
-        // Up-Left
-        if (edgeImg[(r-1)*width+c-1]){
-          if (edgeImg[(r-1)*width+c]){edgeImg[(r-1)*width+c]= 0; pixels[count].r = r-1; pixels[count].c = c; count++;}
-          r--; c--; dir = UP_LEFT; continue;
-        } //end-if
+  EdgeSegment *segment = &map->segments[map->noSegments++];
+  segment->pixels = map->pixels + *totalLen;
 
-        // Down
-        if (edgeImg[(r+1)*width+c]){r++; dir = DOWN; continue;}
+  int len = 0;
+  for (int k=len1-1; k>=0; k--) segment->pixels[len++] = pixels[k];
+  for (int k=len1; k<len1+len2; k++) segment->pixels[len++] = pixels[k];
 
-        // Up
-        if (edgeImg[(r-1)*width+c]){r--; dir = UP; continue;}
+  segment->noPixels = len;
+  *totalLen += len;
+} //end-ReplayAnchor
 
-        // Down-Right
-        if (edgeImg[(r+1)*width+c+1]){r++; c++; dir = DOWN_RIGHT; continue;}
+///----------------------------------------------------------------------------------
+/// A chain walked again is replaced by what the serial walk does from its anchor. Its pixels
+/// that are left differ from what the bands saw, & they are anchors of the serial walk later on.
+/// The pixels of the image borders that the chain cleared are not in the chain, but next to it
+///
+static void ReleaseChain(WalkReplay *replay, WalkChain *chain){
+  ReplayEdgels edgels = {replay};
+  int width = replay->width;
+  int height = replay->height;
+  int id = (int)(chain - replay->chains);
+
+  for (int k=0; k<chain->noPixels; k++){
+    int r = chain->pixels[k].r;
+    int c = chain->pixels[k].c;
+    int o = r*width + c;
+
+    if (edgels[o]){
+      InvalidateReaders(replay, o, INT_MAX);
+      if (r > 0 && r < height-1 && c > 0 && c < width-1) PushAnchor(replay, o);
+    } //end-if
 
-        // Up-Right
-        if (edgeImg[(r-1)*width+c+1]){r--; c++; dir = UP_RIGHT; continue;}
-      } //end-else
+    if (r > 1 && r < height-2 && c > 1 && c < width-2) continue;
 
-      // Nowhere to go
-      return count;
-    } // end-else
-  } //end-while
+    for (int i=r-1; i<=r+1; i++){
+      for (int j=c-1; j<=c+1; j++){
+        if (i < 0 || i >= height || j < 0 || j >= width) continue;
+        if (i > 0 && i < height-1 && j > 0 && j < width-1) continue;
 
-  return count;
-} //end-Walk8Dirs
+        if (edgels[i*width+j] && replay->owners[i*width+j] == id) InvalidateReaders(replay, i*width+j, INT_MAX);
+      } //end-for
+    } //end-for
+  } //end-for
+} //end-ReleaseChain
 
 ///----------------------------------------------------------------------------------
-/// Predictive edge walk using 8 directions
+/// Predictive edge walk using 8 directions over horizontal bands in parallel, with the same
+/// chains as PELWalk8Dirs. Each band is walked independently on a private copy of its rows that
+/// no walk leaves, recording the chain that clears each edgel. Then a serial pass goes over the
+/// anchors of all bands in scan order as PELWalk8Dirs does: A chain is taken as it is unless a
+/// pixel it read differs from what its band saw, because a walk of an earlier chain entered the band
+/// or the chain itself reached the rows of another band. Such a chain is walked again from its
+/// anchor on the edge map, continuing across the band boundaries with its direction predictor, &
+/// the chains it meets are invalidated in turn. The edgels are only read, as the walks use copies
 ///
-EdgeMap *PELWalk8Dirs(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN){
-  EdgeMap *map = new EdgeMap(width, height);
-  Pixel *pixels =  new Pixel[width*height];
+template <class Edgels>
+static void PELWalk8DirsTiled(PELContext *ctx, EdgeMap *map, Edgels edgeImg, int stride, int MIN_SEGMENT_LEN){
+  int width = ctx->width;
+  int height = ctx->height;
+
+  int noBands = ctx->noThreads;
+  if (noBands > MAX_WALK_THREADS) noBands = MAX_WALK_THREADS;
+  if (noBands > (height-2)/2) noBands = (height-2)/2;
+  if (noBands < 1) noBands = 1;
+
+  // Private copies of the bands including the halo rows, then the copy of the edge map of the serial pass
+  int noBandBytes = width*(height+2*noBands);
+  if (noBandBytes + width*height > ctx->maxTileImg){
+    delete[] ctx->tileImg;
+    ctx->maxTileImg = noBandBytes + width*height;
+    ctx->tileImg = new unsigned char[ctx->maxTileImg];
+  } //end-if
+
+  if (width*height > ctx->maxTileOwners){
+    delete[] ctx->tileOwners;
+    ctx->maxTileOwners = width*height;
+    ctx->tileOwners = new int[ctx->maxTileOwners];
+  } //end-if
+
+  WalkBand bands[MAX_WALK_THREADS];
+  unsigned char *img = ctx->tileImg;
+  for (int b=0; b<noBands; b++){
+    bands[b].r0 = 1 + (int)((long long)(height-2)*b/noBands);
+    bands[b].r1 = 1 + (int)((long long)(height-2)*(b+1)/noBands);
+    bands[b].img = img;
+    bands[b].useWalkTable = ctx->useWalkTable;
+
+    img += (bands[b].r1 - bands[b].r0 + 2)*width;
+  } //end-for
 
-  int noSegments = 0;
-  int totalLen = 0;
+  unsigned char *copy = ctx->tileImg + noBandBytes;
+  int *owners = ctx->tileOwners;
+  RunOnBands(ctx, bands, noBands, [=](WalkBand *band){CopyWalkBand(band, edgeImg, width, height, stride, copy, owners);});
+
+  // Partition the chain buffers by the # of edgels of each band
+  int noEdgels = 0;
+  for (int b=0; b<noBands; b++) noEdgels += bands[b].noEdgels;
+
+  if (noEdgels > ctx->maxTileEdgels){
+    delete[] ctx->tilePixels;
+    delete[] ctx->tileChains;
+    delete[] ctx->tileAnchors;
+
+    ctx->maxTileEdgels = noEdgels;
+    ctx->tilePixels = new Pixel[noEdgels];
+    ctx->tileChains = new WalkChain[noEdgels];
+    ctx->tileAnchors = new int[noEdgels];
+  } //end-if
+
+  int offset = 0;
+  for (int b=0; b<noBands; b++){
+    bands[b].scratch = ctx->walkPixels + offset;
+    bands[b].pixels = ctx->tilePixels + offset;
+    bands[b].chains = ctx->tileChains + offset;
+    offset += bands[b].noEdgels;
+  } //end-for
 
-  // Go over the anchors in sorted order
-  for (int i=1; i<height-1; i++){
-    for (int j=1; j<width-1; j++){
-      if (edgeImg[i*width+j] == 0) continue;
+  WalkChain *chains = ctx->tileChains;
+  RunOnBands(ctx, bands, noBands, [=](WalkBand *band){WalkBandChains(band, width, owners, chains);});
 
-#if 0
-      int dir1, dir2;
-      dir1 = dir2 = -1;
+  // Serial pass over the anchors of the bands in scan order
+  WalkReplay replay = {copy, owners, chains, width, height, ctx->tileAnchors, 0};
+  ReplayEdgels edgels = {&replay};
+  WalkFunc<ReplayEdgels> walk = ctx->useWalkTable ? Walk8DirsTable<ReplayEdgels> : Walk8Dirs<ReplayEdgels>;
 
-      // 8 directions
-      if      (edgeImg[i*width+j+1]){dir1 = RIGHT; dir2 = LEFT;}
-      else if (edgeImg[(i+1)*width+j]){dir1 = DOWN; dir2 = UP;}
+  map->noSegments = 0;
+  int totalLen = 0;
 
-      else if (edgeImg[(i+1)*width+j-1]){dir1 = DOWN_LEFT; dir2 = UP_RIGHT;}
-      else if (edgeImg[(i+1)*width+j+1]){dir1 = DOWN_RIGHT; dir2 = UP_LEFT;}
+  for (int b=0; b<noBands; b++){
+    WalkBand *band = &bands[b];
 
-      // Skip single pixel edgels
-      if (dir1 < 0){edgeImg[i*width+j] = 0; continue;}
+    if (b > 0)         InvalidateHaloReaders(&replay, band->r0-1, band->r0);
+    if (b < noBands-1) InvalidateHaloReaders(&replay, band->r1, band->r1-1);
 
-      // Walk using 8 directions
-      int len1 = Walk8Dirs(edgeImg, width, height, i, j, dir1, pixels);
-      int len2 = Walk8Dirs(edgeImg, width, height, i, j, dir2, pixels+len1);
+    for (int k=0; k<=band->noChains; k++){
+      int anchor = k < band->noChains ? band->chains[k].anchor : INT_MAX;
 
-      if (len1+len2-1 < MIN_SEGMENT_LEN) continue;
+      // The edgels left by the chains walked again before this anchor
+      while (replay.noAnchors > 0 && replay.anchors[0] < anchor){
+        int o = PopAnchor(&replay);
+        if (edgels[o]) ReplayAnchor(&replay, o, map, &totalLen, ctx->walkPixels, MIN_SEGMENT_LEN, walk);
+      } //end-while
 
-      map->segments[noSegments].pixels = map->pixels+totalLen;
-      int len = 0;
-      for (int k=len1-1; k>=1; k--){
-        map->segments[noSegments].pixels[len] = pixels[k];
-        len++;
-      } //end-for
+      if (k == band->noChains) break;
 
-      for (int k=len1; k<len1+len2; k++){
-        map->segments[noSegments].pixels[len] = pixels[k];
-        len++;
-      } //end-for
+      WalkChain *chain = &band->chains[k];
+      if (chain->state == CHAIN_PENDING){
+        chain->state = CHAIN_ACCEPTED;
+        if (!chain->walked || chain->noPixels < MIN_SEGMENT_LEN) continue;
 
-      map->segments[noSegments].noPixels = len;
-      noSegments++;
-      totalLen += len;
+        EdgeSegment *segment = &map->segments[map->noSegments++];
+        segment->pixels = map->pixels + totalLen;
+        segment->noPixels = chain->noPixels;
+        memcpy(segment->pixels, chain->pixels, sizeof(Pixel)*chain->noPixels);
+        totalLen += chain->noPixels;
+        continue;
+      } //end-if
+
+      chain->state = CHAIN_REDONE;
+      if (edgels[chain->anchor]) ReplayAnchor(&replay, chain->anchor, map, &totalLen, ctx->walkPixels, MIN_SEGMENT_LEN, walk);
+      ReleaseChain(&replay, chain);
     } //end-for
-  } // end-for
-#else
-      int dir1, dir2;
-      dir1 = dir2 = -1;
+  } //end-for
+} //end-PELWalk8DirsTiled
 
-      // 8 directions
-      if      (edgeImg[i*width+j+1]) dir1 = RIGHT;
-      else if (edgeImg[(i+1)*width+j]) dir1 = DOWN;
+///========================== Step 3: Join Edge Segments ======================================
+///-------------------------------------------------------------------------------------------
+/// Marks the joint points on the segment ownership index & returns it: The pixels of the segments
+/// hold ownerBase + 1 + the id of the last segment through them, and the pixel of another segment
+/// next to the tip of a segment is a joint point, which is negated. Each call starts above the
+/// values of the previous calls, so their entries count as empty without being cleared. Only the
+/// pixels of the segments are written, and the index is cleared only when the values wrap around
+///
+static int *FindJointPoints(PELContext *ctx, EdgeMap *map){
+  int width = map->width;
+  int height = map->height;
 
-      else if (edgeImg[(i+1)*width+j-1]) dir1 = DOWN_LEFT;
-      else if (edgeImg[(i+1)*width+j+1]) dir1 = DOWN_RIGHT;
+  int *owners = ctx->segmentOwners;
 
-      // Skip single pixel edgels
-      if (dir1 < 0){edgeImg[i*width+j] = 0; continue;}
+  if (ctx->ownerBase > INT_MAX - (map->noSegments+1)){
+    memset(owners, 0, sizeof(int)*ctx->maxArea);
+    ctx->ownerBase = 0;
+  } //end-if
 
-      // Walk using 8 directions
-      int len1 = Walk8Dirs(edgeImg, width, height, i, j, dir1, pixels);
-    
-      int sr, sc;
-      if      (edgeImg[i*width+j+1]){dir2 = RIGHT; sr = i; sc = j+1;}
-      else if (edgeImg[(i+1)*width+j]){dir2 = DOWN; sr = i+1; sc = j;}
+  int base = ctx->ownerBase;
+  ctx->ownerBase += map->noSegments+1;
 
-      else if (edgeImg[(i+1)*width+j-1]){dir2 = DOWN_LEFT; sr = i+1; sc = j-1;}
-      else if (edgeImg[(i+1)*width+j+1]){dir2 = DOWN_RIGHT; sr = i+1; sc = j+1;}
+  // The neighbors of a tip in the order they are checked
+  static const int dr[8] = {-1, 1, 0, 0, -1, -1, 1, 1};   // up, down, left, right, up-left, up-right, down-right, down-left
+  static const int dc[8] = {0, 0, -1, 1, -1, 1, 1, -1};
 
-      int len2=0;
-      if (dir2 > 0) len2 = Walk8Dirs(edgeImg, width, height, sr, sc, dir2, pixels+len1);
+  for (int i=0; i<map->noSegments; i++){
+    for (int j=0; j<map->segments[i].noPixels; j++){
+      int r = map->segments[i].pixels[j].r;
+      int c = map->segments[i].pixels[j].c;
 
-      if (len1+len2 < MIN_SEGMENT_LEN) continue;
+      owners[r*width+c] = base+i+1;
+    } //end-for
+  } //end-for
 
-      map->segments[noSegments].pixels = map->pixels+totalLen;
-      int len = 0;
-      for (int k=len1-1; k>=0; k--){
-        map->segments[noSegments].pixels[len] = pixels[k];
-        len++;
-      } //end-for
+  for (int i=0; i<map->noSegments; i++){
+    for (int k=0; k<2; k++){
+      int r, c;
 
-      for (int k=len1; k<len1+len2; k++){
-        map->segments[noSegments].pixels[len] = pixels[k];
-        len++;
-      } //end-for
+      if (k==0){
+        r = map->segments[i].pixels[0].r;
+        c = map->segments[i].pixels[0].c;
 
-      map->segments[noSegments].noPixels = len;
-      noSegments++;
-      totalLen += len;
-    } //end-for
-  } // end-for
-#endif
+      } else {
+        r = map->segments[i].pixels[map->segments[i].noPixels-1].r;
+        c = map->segments[i].pixels[map->segments[i].noPixels-1].c;
+      } //end-else
 
+      if (r <=0 || r>=height-1 || c<=0 || c>=width-1) continue;
 
-  map->noSegments = noSegments;
-  delete pixels;
-  
-  return map;
-} // end-PELWalk8Dirs
+      // A pixel of another segment? The owners marked as joints so far are negative
+      for (int d=0; d<8; d++){
+        int *owner = &owners[(r+dr[d])*width + c+dc[d]];
+        if (abs(*owner) > base && abs(*owner) != base+i+1){*owner = -abs(*owner); break;}
+      } //end-for
+    } //end-for
+  } //end-for
+
+  return owners;
+} //end-FindJointPoints
 
-///========================== Step 3: Join Edge Segments ======================================
 ///-------------------------------------------------------------------------------------------
-/// Returns the joint points. 
+/// The original joint points of ClipEdgeSegmentsMap on a short segment id map & a joints byte
+/// map, both allocated & cleared on every call. The ids of the segments past 32767 wrap around
+/// to negative values, which read as empty pixels, so their joint points are missed
 ///
-static unsigned char *FindJointPoints(EdgeMap *map){
+static unsigned char *FindJointPointsMap(EdgeMap *map){
   int width = map->width;
   int height = map->height;
 
@@ -1098,19 +2921,19 @@ static unsigned char *FindJointPoints(EdgeMap *map){
     } //end-for
   } //end-for
 
-  delete segments;
+  delete[] segments;
   return joints;
-} //end-FindJointPoints
+} //end-FindJointPointsMap
 
 ///---------------------------------------------------------------------
-/// Clip from the tips of the edge segments if there is a neigboring segment
-/// maxClipSize is the maximum # of pixels to clip from the tips of the edge segments
+/// The original ClipEdgeSegments on the maps of FindJointPointsMap, which scans each segment
+/// from both tips up to the first joint point. It is the reference the segment ownership index
+/// is checked against (see PELVerify) & is not meant for production use
 ///
-static void ClipEdgeSegments(EdgeMap *map, int maxClipSize=5){
+static void ClipEdgeSegmentsMap(EdgeMap *map, int maxClipSize){
   int width = map->width;
-  int height = map->height;
     
-  unsigned char *joints = FindJointPoints(map);
+  unsigned char *joints = FindJointPointsMap(map);
 
   for (int i=0; i<map->noSegments; i++){
     // The loopy segments should not be broken
@@ -1156,16 +2979,197 @@ static void ClipEdgeSegments(EdgeMap *map, int maxClipSize=5){
 
   } //end-for
 
-  delete joints;
+  delete[] joints;
+} //end-ClipEdgeSegmentsMap
+
+///---------------------------------------------------------------------
+/// Clip from the tips of the edge segments if there is a neigboring segment
+/// maxClipSize is the maximum # of pixels to clip from the tips of the edge segments
+///
+static void ClipEdgeSegments(PELContext *ctx, EdgeMap *map, int maxClipSize){
+  if (!ctx->useOwnerIndex){ClipEdgeSegmentsMap(map, maxClipSize); return;}
+
+  int width = map->width;
+    
+  int *owners = FindJointPoints(ctx, map);
+
+  for (int i=0; i<map->noSegments; i++){
+    // The loopy segments should not be broken
+    int fr = map->segments[i].pixels[0].r;
+    int fc = map->segments[i].pixels[0].c;
+
+    int lr = map->segments[i].pixels[map->segments[i].noPixels-1].r;
+    int lc = map->segments[i].pixels[map->segments[i].noPixels-1].c;
+
+    // Skip this segment if it forms a loop
+    if (abs(fr-lr) <= 3 && abs(fc-lc) <= 3) continue;
+
+    // Only a joint within maxClipSize pixels of a tip clips it, so no further pixels are looked at
+    for (int k=0; k<=maxClipSize && k<map->segments[i].noPixels; k++){
+      int r = map->segments[i].pixels[k].r;
+      int c = map->segments[i].pixels[k].c;  
+
+      if (owners[r*width+c] < 0){
+        map->segments[i].pixels += k;
+        map->segments[i].noPixels -= k;
+
+        owners[r*width+c] = -owners[r*width+c];
+        break;
+      } //end-if
+    } //end-for
+
+    for (int k=map->segments[i].noPixels-1; k>=0 && map->segments[i].noPixels - k <= maxClipSize; k--){
+      int r = map->segments[i].pixels[k].r;
+      int c = map->segments[i].pixels[k].c;  
+
+      if (owners[r*width+c] < 0){
+        map->segments[i].noPixels = k+1;
+
+        owners[r*width+c] = -owners[r*width+c];
+        break;
+      } //end-if
+    } //end-for
+
+  } //end-for
 } //end-ClipEdgeSegments
 
 ///---------------------------------------------------------------------
-/// Join edge segments whose endpoints are at most 2 pixels away from each other
+/// The slot of the endpoint cell hash holding cell "cell", or the empty slot where it goes.
+/// Linear probing from the cell # modulo the table size: The cells of a row stay next to each
+/// other, so the lookups of the segments, which follow the scan order, hit the cache
 ///
-static void JoinNeighborEdgeSegments(EdgeMap *map){
-  // Clip the tips of the edge segments
-  ClipEdgeSegments(map, 5);
+static inline EndpointCell *FindEndpointCell(EndpointCell *cells, int noSlots, int cell){
+  int h = cell & (noSlots-1);
+
+  while (cells[h].cell != cell && cells[h].cell >= 0) h = (h+1) & (noSlots-1);
+
+  return &cells[h];
+} //end-FindEndpointCell
+
+///---------------------------------------------------------------------
+/// The longest segment other than "seg" with an endpoint in the 5x5 neighborhood of (r, c), -1 if none.
+/// Of the equally long segments, the first in the row by row order of the neighborhood is taken.
+/// The neighborhood overlaps at most 2x2 cells
+///
+static int FindNeighborSegment(PELContext *ctx, EdgeMap *map, int noSlots, int seg, int r, int c){
+  int width = map->width;
+  int cellsPerRow = (width+7) >> 3;
+
+  int neighbor = -1;
+  int len = 0;
+  int pos = 0;   // r*width+c of the neighbor's endpoint
+
+  int firstCol = c-2 < 0 ? 0 : (c-2) >> 3;
+  int lastCol = c+2 >= width ? cellsPerRow-1 : (c+2) >> 3;
+
+  for (int cr=(r-2 < 0 ? 0 : (r-2) >> 3); cr<=(r+2) >> 3; cr++){
+    for (int cc=firstCol; cc<=lastCol; cc++){
+      EndpointCell *cell = FindEndpointCell(ctx->endpointCells, noSlots, cr*cellsPerRow + cc);
+      if (cell->cell < 0) continue;
+
+      Endpoint *endpoint = ctx->endpoints + cell->first;
+      for (int k=0; k<cell->count; k++, endpoint++){
+        if (endpoint->r < r-2 || endpoint->r > r+2 || endpoint->c < c-2 || endpoint->c > c+2) continue;
+        if (endpoint->segment == seg) continue;
+
+        int s = endpoint->segment;
+        int l = map->segments[s].noPixels;
+        if (l > len || (l == len && endpoint->r*width + endpoint->c < pos)){neighbor=s; len = l; pos = endpoint->r*width + endpoint->c;}
+      } //end-for
+    } //end-for
+  } //end-for
+
+  return neighbor;
+} //end-FindNeighborSegment
+
+///---------------------------------------------------------------------
+/// Finds the longest neighbor segment of the two endpoints of each segment with the endpoint
+/// cell index
+///
+static void FindNeighborSegments(PELContext *ctx, EdgeMap *map, SegmentNeighbors *nn){
+  int width = map->width;
+  int cellsPerRow = (width+7) >> 3;
+
+  // Index the endpoints by cell: At most 2*noSegments cells in at least 4 times as many
+  // slots, so a probe of an empty cell ends in a slot or two. The index is O(# of segments)
+  int noSlots = 16;
+  while (noSlots < 8*map->noSegments) noSlots *= 2;
+
+  if (noSlots > ctx->maxEndpointCells){
+    delete[] ctx->endpointCells;
+    ctx->maxEndpointCells = noSlots;
+    ctx->endpointCells = new EndpointCell[ctx->maxEndpointCells];
+  } //end-if
+
+  if (2*map->noSegments > ctx->maxEndpoints){
+    delete[] ctx->endpoints;
+    ctx->maxEndpoints = 2*map->noSegments;
+    ctx->endpoints = new Endpoint[ctx->maxEndpoints];
+  } //end-if
+
+  EndpointCell *cells = ctx->endpointCells;
+  memset(cells, 0xff, sizeof(EndpointCell)*noSlots);
+
+  // Count the endpoints of each cell
+  for (int i=0; i<2*map->noSegments; i++){
+    Pixel *pixel = &map->segments[i>>1].pixels[(i & 1) ? map->segments[i>>1].noPixels-1 : 0];
+    int cell = (pixel->r >> 3)*cellsPerRow + (pixel->c >> 3);
+    EndpointCell *slot = FindEndpointCell(cells, noSlots, cell);
+
+    if (slot->cell < 0){slot->cell = cell; slot->count = 0;}
+    slot->count++;
+  } //end-for
+
+  // Lay the endpoints of the cells out one after the other
+  int noEndpoints = 0;
+  for (int h=0; h<noSlots; h++){
+    if (cells[h].cell < 0) continue;
+
+    cells[h].first = noEndpoints;
+    noEndpoints += cells[h].count;
+    cells[h].count = 0;
+  } //end-for
+
+  // Mark the end of the segments. A later segment overwrites the pixel, as each pixel has one owner
+  for (int i=0; i<2*map->noSegments; i++){
+    Pixel *pixel = &map->segments[i>>1].pixels[(i & 1) ? map->segments[i>>1].noPixels-1 : 0];
+    EndpointCell *slot = FindEndpointCell(cells, noSlots, (pixel->r >> 3)*cellsPerRow + (pixel->c >> 3));
+    Endpoint *endpoints = ctx->endpoints + slot->first;
+
+    int k = 0;
+    while (k < slot->count && (endpoints[k].r != pixel->r || endpoints[k].c != pixel->c)) k++;
+    if (k == slot->count) slot->count++;
+
+    endpoints[k].r = pixel->r;
+    endpoints[k].c = pixel->c;
+    endpoints[k].segment = i>>1;
+  } //end-for
+
+  // Find the neighbors of each segment
+  for (int i=0; i<map->noSegments; i++){
+    int r, c;
+
+    nn[i].taken = false;
+
+    r = map->segments[i].pixels[0].r;
+    c = map->segments[i].pixels[0].c;
+    nn[i].s = FindNeighborSegment(ctx, map, noSlots, i, r, c);
+
+    int index = map->segments[i].noPixels-1;
+    r = map->segments[i].pixels[index].r;
+    c = map->segments[i].pixels[index].c;
+
+    nn[i].e = FindNeighborSegment(ctx, map, noSlots, i, r, c);
+    if (nn[i].e == nn[i].s) nn[i].e = -1;
+  } //end-for
+} //end-FindNeighborSegments
 
+///---------------------------------------------------------------------
+/// The original neighbor search of JoinNeighborEdgeSegments on a width*height map of the
+/// segment endpoints, which is allocated & cleared on every call. It is the reference the
+/// endpoint cell index is checked against (see PELVerify) & is not meant for production use
+///
+static void FindNeighborSegmentsMap(EdgeMap *map, SegmentNeighbors *nn){
   int width = map->width;
   int height = map->height;
 
@@ -1187,14 +3191,6 @@ static void JoinNeighborEdgeSegments(EdgeMap *map){
     segments[r*width+c] = i+1;
   } //end-for
 
-  // Find the neighbors of each segment in the 2x2 neighborhood
-  struct NN {
-    bool taken;   // Is this segment already taken?
-    int s, e;     // Neighbor from the start and end pixel
-  };        
-
-  NN *nn = new NN[map->noSegments];
-
   // Find the neighbors of each segment
   for (int i=0; i<map->noSegments; i++){
     int r, c;
@@ -1243,11 +3239,37 @@ static void JoinNeighborEdgeSegments(EdgeMap *map){
     if (nn[i].e == nn[i].s) nn[i].e = -1;
   } //end-for
 
+  delete[] segments;
+} //end-FindNeighborSegmentsMap
+
+///---------------------------------------------------------------------
+/// Join edge segments whose endpoints are at most 2 pixels away from each other
+/// The tips of the edge segments must be clipped by ClipEdgeSegments first
+///
+static void JoinNeighborEdgeSegments(PELContext *ctx, EdgeMap *map){
+  if (map->noSegments == 0) return;
+
+  // Grow the per segment buffers if necessary
+  if (map->noSegments > ctx->maxSegments){
+    delete[] ctx->neighbors;
+    delete[] ctx->listBuffer;
+
+    ctx->maxSegments = map->noSegments;
+    ctx->neighbors = new SegmentNeighbors[ctx->maxSegments];
+    ctx->listBuffer = new int[ctx->maxSegments*2];
+  } //end-if
+
+  // Find the neighbors of each segment in the 2x2 neighborhood
+  SegmentNeighbors *nn = ctx->neighbors;
+
+  if (ctx->useEndpointHash) FindNeighborSegments(ctx, map, nn);
+  else                      FindNeighborSegmentsMap(map, nn);
+
   // Now join. Create a new edgemap for the joined edge segments
   int noSegments2 = 0;
-  EdgeSegment *segments2 = new EdgeSegment[map->noSegments*4];
+  EdgeSegment *segments2 = ctx->joinSegments;
   Pixel *pix2 = map->segments[map->noSegments-1].pixels + map->segments[map->noSegments-1].noPixels;
-  int *listBuffer = new int[map->noSegments*2];
+  int *listBuffer = ctx->listBuffer;
 
   for (int i=0; i<map->noSegments; i++){
     // Already taken? Then skip.
@@ -1308,7 +3330,7 @@ static void JoinNeighborEdgeSegments(EdgeMap *map){
     // Copy the pixels of the first segment in the list
     // This is junction (curr, next)
     int curr = list[0];
-    int next = list[1];
+    int next = (listSize > 1) ? list[1] : -1;
 
     if (nn[curr].e == next){
       // Copy the pixels of the current segment in forward order
@@ -1349,12 +3371,12 @@ static void JoinNeighborEdgeSegments(EdgeMap *map){
   } //end-for
 
   map->noSegments = noSegments2;
-  delete map->segments;
+  ctx->joinSegments = map->segments;
   map->segments = segments2;
 
-  delete listBuffer;
-  delete nn;
-  delete segments;
+  int maxSegments2 = ctx->maxJoinSegments;
+  ctx->maxJoinSegments = map->maxSegments;
+  map->maxSegments = maxSegments2;
 } //end-JoinEdgeSegments
 
 ///============================= Step 4: ThinEdgeSegments ==================================
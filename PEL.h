@@ -19,7 +19,177 @@
 #ifndef _PEL_H_
 #define _PEL_H_
 
-// Link edges and return an edgemap (Predictive edge linking)
-EdgeMap *PEL(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN=10);
+#include "EdgeMap.h"
+
+// Neighbors of an edge segment found by JoinNeighborEdgeSegments
+struct SegmentNeighbors {
+  bool taken;   // Is this segment already taken?
+  int s, e;     // Neighbor from the start and end pixel
+};
+
+// Endpoint index of JoinNeighborEdgeSegments: The endpoints are grouped by 8x8 cell of the image,
+// and the non-empty cells are kept in a hash table
+struct EndpointCell {
+  int cell;     // Cell # (-1: empty slot)
+  int first;    // Index of the first endpoint of the cell
+  int count;    // # of endpoints of the cell
+};
+
+struct Endpoint {
+  int r, c;
+  int segment;  // The last segment with an endpoint at the pixel
+};
+
+// Threads of the tiled walk (see PEL.cpp)
+struct WalkWorkers;
+
+// A chain walked by a band of the tiled walk
+struct WalkChain {
+  Pixel *pixels;
+  int noPixels;
+  int anchor;     // Offset of the pixel the chain was walked from
+  bool walked;    // false for a single pixel edgel, which is only cleared
+  int state;      // How the serial pass of the tiled walk takes the chain
+};
+
+// A rectangular region of an image
+struct PELRect {
+  int x, y;            // Top-left pixel
+  int width, height;
+};
+
+///-------------------------------------------------------------------------------
+/// Per stage times (in milliseconds) & counters of a Link() call. Each stage of Link()
+/// fills in its own fields only
+///
+struct PELStats {
+  double fillGapsTime;          // FillGaps2
+  double walkTime;              // PELWalk8Dirs
+  double clipTime;              // ClipEdgeSegments
+  double joinTime;              // JoinNeighborEdgeSegments
+  double thinTime;              // ThinEdgeSegments
+  double fixTime;               // FixEdgeSegments
+
+  int noEdgels;                 // # of edgels after the gaps are filled
+  int noGapsFilled;             // # of gap pixels turned into edgels
+  int noChains;                 // # of chains kept by the walk
+  int noJoins;                  // # of segments joined to a neighbor segment
+  int noSegments;               // # of edge segments in the final edgemap
+
+  double TotalTime() const {return fillGapsTime + walkTime + clipTime + joinTime + thinTime + fixTime;}
+};
+
+///-------------------------------------------------------------------------------
+/// PEL working set for a given resolution. Create it once and call Link() for
+/// every frame: all scratch buffers are kept across calls, so steady-state calls
+/// do no heap allocations. The returned EdgeMap is owned by the context and is
+/// valid until the next call to Link()
+///
+struct PELContext {
+public:
+  int width, height;            // Width & height of the image
+
+  EdgeMap *map;                 // Linked edge segments
+  Pixel *walkPixels;            // Scratch chain buffer of PELWalk8Dirs
+  int maxWalkPixels;            // # of pixels walkPixels can hold
+
+  int *segmentOwners;           // Segment ownership index of FindJointPoints & ClipEdgeSegments: ownerBase + 1 + the id
+                                // of the last segment through a pixel, negated at the joint points
+  int ownerBase;                // The entries of segmentOwners up to ownerBase are from earlier calls & count as empty
+  bool useOwnerIndex;           // Find the joint points on segmentOwners. false: the original short segment id & joints
+                                // maps, allocated per call, which miss joints past 32767 segments (reference of PELVerify).
+                                // Default: true
+  EndpointCell *endpointCells; // Hashed cells of the segment endpoints of JoinNeighborEdgeSegments
+  int maxEndpointCells;         // # of slots endpointCells can hold
+  Endpoint *endpoints;          // Segment endpoints of JoinNeighborEdgeSegments
+  int maxEndpoints;             // # of endpoints the array can hold
+  bool useEndpointHash;         // Find the neighbor segments with the endpoint cell index. false: the original
+                                // width*height endpoint map, allocated per call (reference of PELVerify). Default: true
+
+  EdgeSegment *joinSegments;    // Output segments of JoinNeighborEdgeSegments (swapped with map->segments)
+  int maxJoinSegments;          // # of segments joinSegments can hold
+
+  SegmentNeighbors *neighbors;  // Per segment neighbors of JoinNeighborEdgeSegments
+  int *listBuffer;              // Segment list to be joined
+  int maxSegments;              // # of segments the above two buffers can hold
+
+  bool useSIMD;                 // Fill the gaps with SSE2/AVX2 (chosen at runtime) if available. Default: true
+  bool useEdgelIndex;           // Skip the empty blocks of sparse edge maps. Default: true
+  EdgelIndex *index;            // Edgel index of the current frame
+  bool useWalkTable;            // Walk with the table-driven kernel (same chains as Walk8Dirs). Default: false
+  bool useBitmap;               // Fill the gaps & walk on a packed bitmap of 1 bit per pixel built from the
+                                // edge map, which is then left untouched (same chains). Default: true
+  unsigned long long *bitmap;   // The edgel & the 255 pixel bitmaps of useBitmap
+  int maxBitmapWords;           // # of words bitmap can hold
+
+  int noThreads;                // # of threads of the edge walk. 1: Serial walk (default). More: Tiled walk (same chains)
+  WalkWorkers *walkWorkers;     // Threads of the tiled walk, started by its first call & kept for the next ones
+  unsigned char *tileImg;       // Private copies of the bands walked in parallel, then a copy of the edge map
+  int maxTileImg;
+  Pixel *tilePixels;            // Pixels of the chains walked in the bands
+  WalkChain *tileChains;        // Chains walked in the bands
+  int *tileAnchors;             // Anchors left to the serial pass of the tiled walk
+  int maxTileEdgels;            // # of edgels the above three buffers can hold
+  int *tileOwners;              // Chain of the bands that cleared each pixel, -1 if none
+  int maxTileOwners;
+
+  int maxArea;                  // # of pixels the per pixel maps can hold
+  EdgeMap *regionMap;           // Linked edge segments of LinkRegions()
+
+  unsigned char *edgelBits;     // Gaps filled & edgels walked on a read-only edge map, 1 bit per pixel
+  int maxEdgelBits;             // # of bytes edgelBits can hold
+
+  PELStats stats;               // Stats of the last call to Link()
+
+public:
+  PELContext(int w, int h);
+  ~PELContext();
+
+  // Re-target the context to another resolution, e.g., for a batch of images of different sizes
+  void Resize(int w, int h);
+
+  // Link edges of "edgeImg" (modified in place unless useBitmap). Returns the context's edgemap
+  // The rows of edgeImg are "stride" bytes apart (0: width), so it can be a view into a larger image
+  EdgeMap *Link(unsigned char *edgeImg, int MIN_SEGMENT_LEN=10, int stride=0);
+
+  // Link edges of a read-only "edgeImg" into the same edgemap: The gaps filled & the edgels walked
+  // are kept in edgelBits instead, so no copy of the image is needed to keep it, and several
+  // contexts may link the same image at the same time, e.g., with different parameters
+  EdgeMap *Link(const unsigned char *edgeImg, int MIN_SEGMENT_LEN=10, int stride=0);
+
+  // Link edges of a bit-packed edge map, e.g., the pixels of a PBM (P4) image: Row i starts at
+  // bits + i*stride (0: (width+7)/8 bytes), and column c is bit 7-c%8 of byte c/8 of the row, 1 for
+  // an edgel. The gaps are filled & the edges walked on the packed form (see useBitmap)
+  EdgeMap *LinkBits(const unsigned char *bits, int MIN_SEGMENT_LEN=10, int stride=0);
+
+  // Link edges of the regions of an image with "stride" bytes per row in place: Only the
+  // pixels of the regions are read & written, so the work scales with their area. Each region is
+  // linked on its own & the regions should not overlap. Returns the segments of all regions in
+  // image coordinates, in an imageWidth x imageHeight edgemap owned by the context. The context
+  // keeps its size
+  EdgeMap *LinkRegions(unsigned char *image, int imageWidth, int imageHeight, int stride,
+                       const PELRect *regions, int noRegions, int MIN_SEGMENT_LEN=10);
+
+  // The three stages of Link() on a given edgemap. Different frames can be in different
+  // stages at the same time, each stage using its own context (see PELPipeline)
+  void LinkWalk(unsigned char *edgeImg, EdgeMap *map, int stride=0);  // Fill the gaps & walk the edges
+  void LinkWalk(const unsigned char *edgeImg, EdgeMap *map, int stride=0);
+  void LinkWalkBits(const unsigned char *bits, EdgeMap *map, int stride=0);
+  void LinkJoin(EdgeMap *map);                                        // Join neighbor edge segments
+  void LinkFinish(EdgeMap *map, int MIN_SEGMENT_LEN=10);              // Thin down & fix the edge segments
+
+  // Hand over the ownership of the edgemap to the caller
+  EdgeMap *DetachMap();
+};
+
+// Link edges and return an edgemap (Predictive edge linking). The stats of the run are copied to "stats" if not NULL
+EdgeMap *PEL(unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN=10, PELStats *stats=NULL);
+EdgeMap *PEL(const unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN=10, PELStats *stats=NULL);  // edgeImg is left untouched
+EdgeMap *PELBits(const unsigned char *bits, int width, int height, int MIN_SEGMENT_LEN=10, PELStats *stats=NULL);   // See PELContext::LinkBits
+
+// Direction predictions of the 8 directional walk, to check them against a reference (see PELVerify).
+// Directions are 1..8 clockwise from UP_LEFT to LEFT. After each direction dirs[i] is added to the
+// predictor, nextDirs[8*i+analysisDir-1] is set to its prediction for each analysis direction
+void PELPredictDirs(const int *dirs, int noDirs, int *nextDirs);
 
 #endif
\ No newline at end of file
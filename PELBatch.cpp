@@ -0,0 +1,204 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "Timer.h"
+#include "PELBatch.h"
+#include "SegmentFile.h"
+
+PELBatch::PELBatch(int noThreads, int MIN_SEGMENT_LEN, const char *outDir){
+  if (noThreads <= 0) noThreads = (int)std::thread::hardware_concurrency();
+  if (noThreads <= 0) noThreads = 1;
+
+  this->noThreads = noThreads;
+  this->MIN_SEGMENT_LEN = MIN_SEGMENT_LEN;
+  this->outDir = outDir;
+  saveSegments = false;
+
+  contexts = new PELContext *[noThreads];
+  for (int i=0; i<noThreads; i++) contexts[i] = NULL;
+
+  deques = new BatchDeque[noThreads];
+  images = new PGMImage[noThreads];
+
+  files = NULL;
+  results = NULL;
+} //end-PELBatch
+
+PELBatch::~PELBatch(){
+  for (int i=0; i<noThreads; i++) delete contexts[i];
+  delete[] contexts;
+  delete[] deques;
+  delete[] images;
+} //end-~PELBatch
+
+///-------------------------------------------------------------------------------
+/// Take the next job of the worker's own range. Returns false if it is empty
+///
+static bool TakeJob(BatchDeque *deque, int *job){
+  std::lock_guard<std::mutex> guard(deque->lock);
+  if (deque->front >= deque->back) return false;
+
+  *job = deque->front++;
+  return true;
+} //end-TakeJob
+
+///-------------------------------------------------------------------------------
+/// Move the back half of the victim's range to the thief's (empty) range. Returns false if there is nothing to steal
+///
+static bool StealJobs(BatchDeque *victim, BatchDeque *thief){
+  int front, back;
+  {
+    std::lock_guard<std::mutex> guard(victim->lock);
+    int noJobs = victim->back - victim->front;
+    if (noJobs <= 0) return false;
+
+    back = victim->back;
+    front = back - (noJobs+1)/2;
+    victim->back = front;
+  }
+
+  std::lock_guard<std::mutex> guard(thief->lock);
+  thief->front = front;
+  thief->back = back;
+
+  return true;
+} //end-StealJobs
+
+///-------------------------------------------------------------------------------
+/// Read, link & save an image with the worker's context
+///
+static void LinkImage(PELBatch *batch, int worker, int job){
+  BatchResult *result = &batch->results[job];
+  memset(result, 0, sizeof(BatchResult));
+  result->worker = worker;
+
+  Timer timer;
+  timer.Start();
+
+  PGMImage *image = &batch->images[worker];
+  if (!image->Load(batch->files[job])){
+    result->failed = true;
+    return;
+  } //end-if
+
+  int width = image->width;
+  int height = image->height;
+
+  timer.Stop();
+  result->readTime = timer.ElapsedTime();
+  result->width = width;
+  result->height = height;
+
+  PELContext *ctx = batch->contexts[worker];
+  if (ctx == NULL) ctx = batch->contexts[worker] = new PELContext(width, height);
+  else             ctx->Resize(width, height);
+
+  timer.Start();
+
+  EdgeMap *map = ctx->Link(image->pixels, batch->MIN_SEGMENT_LEN);
+
+  timer.Stop();
+  result->linkTime = timer.ElapsedTime();
+  image->Unload();
+
+  result->noSegments = map->noSegments;
+  for (int i=0; i<map->noSegments; i++) result->noPixels += map->segments[i].noPixels;
+
+  if (batch->outDir == NULL) return;
+
+  timer.Start();
+
+  // <outDir>/<name without the extension>-PEL.pgm (or .seg)
+  const char *name = batch->files[job];
+  const char *slash = strrchr(name, '/');
+  const char *backslash = strrchr(name, '\\');
+  if (backslash > slash) slash = backslash;
+  if (slash) name = slash+1;
+
+  int len = (int)strlen(name);
+  const char *dot = strrchr(name, '.');
+  if (dot) len = (int)(dot - name);
+
+  char *path = new char[strlen(batch->outDir) + len + 10];
+  sprintf(path, "%s/%.*s-PEL.%s", batch->outDir, len, name, batch->saveSegments ? "seg" : "pgm");
+
+  if (batch->saveSegments){
+    if (!SaveSegmentFile(path, map)) result->failed = true;
+
+  } else {
+    map->ConvertEdgeSegments2EdgeImg();
+    if (SaveImagePGM(path, (char *)map->edgeImg, width, height) == 0) result->failed = true;
+  } //end-else
+  delete[] path;
+
+  timer.Stop();
+  result->saveTime = timer.ElapsedTime();
+} //end-LinkImage
+
+///-------------------------------------------------------------------------------
+/// Link the images of the worker's range, then steal from the others until all are empty.
+/// No jobs are added during a batch, so a sweep that finds nothing to steal ends the worker
+///
+static void RunWorker(PELBatch *batch, int worker){
+  BatchDeque *own = &batch->deques[worker];
+
+  while (1){
+    int job;
+
+    if (!TakeJob(own, &job)){
+      bool stolen = false;
+      for (int i=1; i<batch->noThreads && !stolen; i++) stolen = StealJobs(&batch->deques[(worker+i) % batch->noThreads], own);
+
+      if (!stolen) break;
+      continue;
+    } //end-if
+
+    LinkImage(batch, worker, job);
+  } //end-while
+} //end-RunWorker
+
+int PELBatch::Run(char **files, int noFiles, BatchResult *results){
+  this->files = files;
+  this->results = results;
+
+  // Split the images evenly
+  for (int i=0; i<noThreads; i++){
+    deques[i].front = (int)((long long)noFiles*i/noThreads);
+    deques[i].back = (int)((long long)noFiles*(i+1)/noThreads);
+  } //end-for
+
+  if (noThreads == 1){
+    RunWorker(this, 0);
+
+  } else {
+    std::thread *workers = new std::thread[(unsigned int)noThreads];
+    for (int i=0; i<noThreads; i++) workers[i] = std::thread(RunWorker, this, i);
+    for (int i=0; i<noThreads; i++) workers[i].join();
+    delete[] workers;
+  } //end-else
+
+  int noFailed = 0;
+  for (int i=0; i<noFiles; i++) if (results[i].failed) noFailed++;
+
+  return noFailed;
+} //end-Run
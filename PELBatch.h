@@ -0,0 +1,74 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _PEL_BATCH_H_
+#define _PEL_BATCH_H_
+
+#include <mutex>
+
+#include "PEL.h"
+#include "ImageIO.h"
+
+// Result of an image of a batch
+struct BatchResult {
+  bool failed;              // Could the image not be read or saved?
+  int worker;               // Worker that linked the image
+  int width, height;
+  int noSegments, noPixels;
+  double readTime, linkTime, saveTime;   // In ms
+};
+
+///-------------------------------------------------------------------------------
+/// Jobs of a worker: The range [front, back) of image indices. The owner takes jobs
+/// from the front, idle workers steal the back half of the remaining range
+///
+struct BatchDeque {
+  int front, back;
+  std::mutex lock;
+};
+
+///-------------------------------------------------------------------------------
+/// Links a batch of images on a work-stealing pool of threads. Each worker has its own
+/// PELContext & PGMImage loader that are re-used for all the images it links. The images are
+/// split evenly across the workers up front; a worker that runs out of images steals
+/// half of the remaining images of another, so slow images do not stall the batch
+///
+struct PELBatch {
+public:
+  int noThreads;            // # of workers
+  int MIN_SEGMENT_LEN;
+  const char *outDir;       // Save the linked edge maps as <outDir>/<name>-PEL.pgm. NULL: do not save
+  bool saveSegments;        // Save segment files (<name>-PEL.seg, see SegmentFile.h) instead. Default: false
+
+  PELContext **contexts;    // Per worker contexts. Created with the first image of the worker
+  PGMImage *images;         // Per worker image loaders
+  BatchDeque *deques;       // Per worker jobs
+
+  char **files;             // Images of the current batch
+  BatchResult *results;
+
+public:
+  // noThreads <= 0: One worker per hardware thread
+  PELBatch(int noThreads=0, int MIN_SEGMENT_LEN=10, const char *outDir=NULL);
+  ~PELBatch();
+
+  // Link "files" into "results" (one per file). Returns the # of failed images
+  int Run(char **files, int noFiles, BatchResult *results);
+};
+
+#endif
@@ -0,0 +1,247 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "EdgeMap.h"
+#include "PEL.h"
+#include "SyntheticEdges.h"
+#include "Timer.h"
+
+///-------------------------------------------------------------------------------
+/// PEL benchmark: Links synthetic edge maps of every kind & size, and reports the time of
+/// each stage & of the whole Link() along with the throughput in megapixels & edgels per second
+///
+///   PELBench [-sizes WxH,WxH,...] [-kinds lines,circles,...] [-density d] [-reps N] [-warmup N]
+///            [-scalar] [-noindex] [-table] [-nobitmap] [-threads N] [-const] [-bits] [-csv]
+///
+/// -scalar, -noindex, -table, -nobitmap & -threads select the variants of PELContext to compare.
+/// -const links the maps through the read-only API, -bits packs them to a bit per pixel once & links
+/// them with LinkBits
+///
+
+static const char *defaultSizes = "256x256,512x512,1024x1024,1920x1080,3840x2160,7680x4320";
+
+// Benchmark settings
+struct BenchArgs {
+  int noSizes;
+  int widths[32], heights[32];
+  bool kinds[SYNTH_NO_KINDS];
+  double density;           // <= 0: The default density of each kind
+  int noReps, noWarmups;
+  bool useSIMD, useEdgelIndex, useWalkTable, useBitmap;
+  int noThreads;
+  bool readOnly;            // Link the map as a const image
+  bool packed;              // Link the map packed to a bit per pixel
+  bool csv;
+};
+
+static bool ParseSizes(const char *str, BenchArgs *args);
+static bool ParseKinds(const char *str, BenchArgs *args);
+static void BenchEdgeMap(PELContext *ctx, unsigned char *src, unsigned char *work, SyntheticKind kind, BenchArgs *args);
+static void PackEdgeMap(unsigned char *src, int width, int height, unsigned char *bits);
+
+int main(int argc, char **argv){
+  BenchArgs args;
+  memset(&args, 0, sizeof(args));
+  for (int k=0; k<SYNTH_NO_KINDS; k++) args.kinds[k] = true;
+  args.noReps = 5;
+  args.noWarmups = 1;
+  args.useSIMD = true;
+  args.useEdgelIndex = true;
+  args.useBitmap = true;
+  args.noThreads = 1;
+  ParseSizes(defaultSizes, &args);
+
+  for (int i=1; i<argc; i++){
+    bool ok = true;
+    if      (strcmp(argv[i], "-sizes") == 0 && i+1 < argc) ok = ParseSizes(argv[++i], &args);
+    else if (strcmp(argv[i], "-kinds") == 0 && i+1 < argc) ok = ParseKinds(argv[++i], &args);
+    else if (strcmp(argv[i], "-density") == 0 && i+1 < argc) ok = (args.density = atof(argv[++i])) > 0 && args.density <= 1;
+    else if (strcmp(argv[i], "-reps") == 0 && i+1 < argc) ok = (args.noReps = atoi(argv[++i])) > 0;
+    else if (strcmp(argv[i], "-warmup") == 0 && i+1 < argc) ok = (args.noWarmups = atoi(argv[++i])) >= 0;
+    else if (strcmp(argv[i], "-threads") == 0 && i+1 < argc) ok = (args.noThreads = atoi(argv[++i])) > 0;
+    else if (strcmp(argv[i], "-scalar") == 0) args.useSIMD = false;
+    else if (strcmp(argv[i], "-noindex") == 0) args.useEdgelIndex = false;
+    else if (strcmp(argv[i], "-table") == 0) args.useWalkTable = true;
+    else if (strcmp(argv[i], "-nobitmap") == 0) args.useBitmap = false;
+    else if (strcmp(argv[i], "-const") == 0) args.readOnly = true;
+    else if (strcmp(argv[i], "-bits") == 0) args.packed = true;
+    else if (strcmp(argv[i], "-csv") == 0) args.csv = true;
+    else ok = false;
+
+    if (!ok){
+      fprintf(stderr, "Usage: %s [-sizes WxH,WxH,...] [-kinds lines,circles,speckle,texture,gaps,joins] [-density d]\n"
+                      "          [-reps N] [-warmup N] [-scalar] [-noindex] [-table] [-nobitmap] [-threads N] [-const] [-bits] [-csv]\n", argv[0]);
+      return 1;
+    } //end-if
+  } //end-for
+
+  if (args.csv) printf("kind,width,height,density,edgels,segments,minMs,meanMs,MPixelsPerSec,MEdgelsPerSec,fillGapsMs,walkMs,clipMs,joinMs,thinMs,fixMs\n");
+  else printf("%-8s %11s %9s %8s %9s %9s %8s %9s | %7s %7s %7s %7s %7s %7s\n", "kind", "size", "edgels", "segments", "min ms", "mean ms", "MP/s", "Medgels/s",
+              "fill", "walk", "clip", "join", "thin", "fix");
+
+  for (int s=0; s<args.noSizes; s++){
+    int width = args.widths[s];
+    int height = args.heights[s];
+
+    unsigned char *src = new unsigned char[width*height];
+    unsigned char *work = new unsigned char[width*height];
+    PELContext ctx(width, height);
+    ctx.useSIMD = args.useSIMD;
+    ctx.useEdgelIndex = args.useEdgelIndex;
+    ctx.useWalkTable = args.useWalkTable;
+    ctx.useBitmap = args.useBitmap;
+    ctx.noThreads = args.noThreads;
+
+    for (int k=0; k<SYNTH_NO_KINDS; k++){
+      if (args.kinds[k]) BenchEdgeMap(&ctx, src, work, (SyntheticKind)k, &args);
+    } //end-for
+
+    delete[] src;
+    delete[] work;
+  } //end-for
+
+  return 0;
+} //end-main
+
+///-------------------------------------------------------------------------------
+/// Generates a map of the given kind, links it noWarmups times untimed & noReps times timed.
+/// Every run links a fresh copy of the map since Link() modifies its input, or the map itself with -const,
+/// or its packed form in "work" with -bits
+///
+static void BenchEdgeMap(PELContext *ctx, unsigned char *src, unsigned char *work, SyntheticKind kind, BenchArgs *args){
+  int width = ctx->width;
+  int height = ctx->height;
+  double density = args->density > 0 ? args->density : SyntheticDensities[kind];
+
+  GenerateEdgeMap(src, width, height, kind, density, (unsigned int)(width*31 + height*17 + kind));
+  if (args->packed) PackEdgeMap(src, width, height, work);
+
+  for (int i=0; i<args->noWarmups; i++){
+    if (args->packed) ctx->LinkBits(work);
+    else if (args->readOnly) ctx->Link((const unsigned char *)src);
+    else {memcpy(work, src, width*height); ctx->Link(work);}
+  } //end-for
+
+  Timer timer;
+  PELStats sum;
+  memset(&sum, 0, sizeof(sum));
+  double minTime = 1e30, totalTime = 0;
+
+  for (int i=0; i<args->noReps; i++){
+    if (!args->readOnly && !args->packed) memcpy(work, src, width*height);
+
+    timer.Start();
+    if (args->packed) ctx->LinkBits(work);
+    else if (args->readOnly) ctx->Link((const unsigned char *)src);
+    else                ctx->Link(work);
+    timer.Stop();
+
+    double time = timer.ElapsedTime();
+    if (time < minTime) minTime = time;
+    totalTime += time;
+
+    sum.fillGapsTime += ctx->stats.fillGapsTime;
+    sum.walkTime += ctx->stats.walkTime;
+    sum.clipTime += ctx->stats.clipTime;
+    sum.joinTime += ctx->stats.joinTime;
+    sum.thinTime += ctx->stats.thinTime;
+    sum.fixTime += ctx->stats.fixTime;
+  } //end-for
+
+  int n = args->noReps;
+  double meanTime = totalTime/n;
+  int noEdgels = ctx->stats.noEdgels;
+  double mpixels = minTime > 0 ? width*(double)height/(minTime*1e3) : 0;
+  double medgels = minTime > 0 ? noEdgels/(minTime*1e3) : 0;
+
+  if (args->csv){
+    printf("%s,%d,%d,%.4f,%d,%d,%.4f,%.4f,%.2f,%.2f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", SyntheticKindNames[kind], width, height, density,
+           noEdgels, ctx->stats.noSegments, minTime, meanTime, mpixels, medgels,
+           sum.fillGapsTime/n, sum.walkTime/n, sum.clipTime/n, sum.joinTime/n, sum.thinTime/n, sum.fixTime/n);
+
+  } else {
+    char size[32];
+    sprintf(size, "%dx%d", width, height);
+    printf("%-8s %11s %9d %8d %9.2lf %9.2lf %8.1lf %9.1lf | %7.2lf %7.2lf %7.2lf %7.2lf %7.2lf %7.2lf\n", SyntheticKindNames[kind], size,
+           noEdgels, ctx->stats.noSegments, minTime, meanTime, mpixels, medgels,
+           sum.fillGapsTime/n, sum.walkTime/n, sum.clipTime/n, sum.joinTime/n, sum.thinTime/n, sum.fixTime/n);
+  } //end-else
+
+  fflush(stdout);
+} //end-BenchEdgeMap
+
+///-------------------------------------------------------------------------------
+/// Packs an edge map to rows of (width+7)/8 bytes as a PBM image does: 8 pixels per byte with
+/// the leftmost in the most significant bit
+///
+static void PackEdgeMap(unsigned char *src, int width, int height, unsigned char *bits){
+  int rowBytes = (width+7)/8;
+  memset(bits, 0, rowBytes*height);
+
+  for (int r=0; r<height; r++){
+    for (int c=0; c<width; c++){
+      if (src[r*width+c]) bits[r*rowBytes + c/8] |= 0x80 >> (c%8);
+    } //end-for
+  } //end-for
+} //end-PackEdgeMap
+
+///-------------------------------------------------------------------------------
+/// Parses a comma separated list of WxH sizes
+///
+static bool ParseSizes(const char *str, BenchArgs *args){
+  args->noSizes = 0;
+
+  while (*str){
+    int w, h, n = 0;
+    if (sscanf(str, "%dx%d%n", &w, &h, &n) != 2 || w < 8 || h < 8 || args->noSizes == 32) return false;
+
+    args->widths[args->noSizes] = w;
+    args->heights[args->noSizes] = h;
+    args->noSizes++;
+
+    str += n;
+    if (*str == ',') str++;
+    else if (*str) return false;
+  } //end-while
+
+  return args->noSizes > 0;
+} //end-ParseSizes
+
+///-------------------------------------------------------------------------------
+/// Parses a comma separated list of kind names
+///
+static bool ParseKinds(const char *str, BenchArgs *args){
+  for (int k=0; k<SYNTH_NO_KINDS; k++) args->kinds[k] = false;
+
+  while (*str){
+    int len = (int)strcspn(str, ",");
+    int k = 0;
+    while (k < SYNTH_NO_KINDS && ((int)strlen(SyntheticKindNames[k]) != len || strncmp(str, SyntheticKindNames[k], len) != 0)) k++;
+    if (k == SYNTH_NO_KINDS) return false;
+
+    args->kinds[k] = true;
+    str += len;
+    if (*str == ',') str++;
+  } //end-while
+
+  return true;
+} //end-ParseKinds
@@ -0,0 +1,156 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <thread>
+
+#include "PELPipeline.h"
+
+FrameQueue::FrameQueue(int capacity){
+  this->capacity = capacity;
+  items = new PELFrame *[capacity];
+  head = 0;
+  count = 0;
+} //end-FrameQueue
+
+FrameQueue::~FrameQueue(){
+  delete[] items;
+} //end-~FrameQueue
+
+void FrameQueue::Put(PELFrame *frame){
+  std::unique_lock<std::mutex> guard(lock);
+  while (count == capacity) notFull.wait(guard);
+
+  items[(head+count) % capacity] = frame;
+  count++;
+
+  notEmpty.notify_one();
+} //end-Put
+
+PELFrame *FrameQueue::Get(){
+  std::unique_lock<std::mutex> guard(lock);
+  while (count == 0) notEmpty.wait(guard);
+
+  PELFrame *frame = items[head];
+  head = (head+1) % capacity;
+  count--;
+
+  notFull.notify_one();
+  return frame;
+} //end-Get
+
+PELPipeline::PELPipeline(int width, int height, int noFrames, int MIN_SEGMENT_LEN){
+  this->width = width;
+  this->height = height;
+  this->MIN_SEGMENT_LEN = MIN_SEGMENT_LEN;
+  if (noFrames < 1) noFrames = 1;
+  this->noFrames = noFrames;
+
+  frames = new PELFrame[noFrames];
+  for (int i=0; i<noFrames; i++){
+    frames[i].frameNo = -1;
+    frames[i].edgeImg = new unsigned char[width*height];
+    frames[i].map = new EdgeMap(width, height);
+  } //end-for
+
+  for (int i=0; i<3; i++) contexts[i] = new PELContext(width, height);
+
+  // Room for every frame plus the end of sequence marker (NULL)
+  for (int i=0; i<5; i++) queues[i] = new FrameQueue(noFrames+1);
+} //end-PELPipeline
+
+PELPipeline::~PELPipeline(){
+  for (int i=0; i<noFrames; i++){
+    delete[] frames[i].edgeImg;
+    delete frames[i].map;
+  } //end-for
+  delete[] frames;
+
+  for (int i=0; i<3; i++) delete contexts[i];
+  for (int i=0; i<5; i++) delete queues[i];
+} //end-~PELPipeline
+
+///-------------------------------------------------------------------------------
+/// Runs a stage of Link on the frames of its input queue until the end of sequence marker
+///
+static void RunStage(PELPipeline *pipeline, int stage){
+  PELContext *ctx = pipeline->contexts[stage];
+  FrameQueue *in = pipeline->queues[stage+1];
+  FrameQueue *out = pipeline->queues[stage+2];
+
+  while (1){
+    PELFrame *frame = in->Get();
+
+    if (frame){
+      if      (stage == 0) ctx->LinkWalk(frame->edgeImg, frame->map);
+      else if (stage == 1) ctx->LinkJoin(frame->map);
+      else                 ctx->LinkFinish(frame->map, pipeline->MIN_SEGMENT_LEN);
+    } //end-if
+
+    out->Put(frame);
+    if (frame == NULL) break;
+  } //end-while
+} //end-RunStage
+
+///-------------------------------------------------------------------------------
+/// Hands the linked frames over to "write" & returns them to the pool
+///
+static void RunWriter(PELPipeline *pipeline, PELWriteFunc write, void *arg){
+  FrameQueue *in = pipeline->queues[4];
+
+  while (1){
+    PELFrame *frame = in->Get();
+    if (frame == NULL) break;
+
+    write(frame->frameNo, frame->map, arg);
+    pipeline->queues[0]->Put(frame);
+  } //end-while
+} //end-RunWriter
+
+///-------------------------------------------------------------------------------
+/// Link a sequence of frames in the pipeline
+///
+int PELPipeline::Run(PELReadFunc read, PELWriteFunc write, void *arg){
+  for (int i=0; i<noFrames; i++) queues[0]->Put(&frames[i]);
+
+  std::thread stages[3];
+  for (int i=0; i<3; i++) stages[i] = std::thread(RunStage, this, i);
+  std::thread writer(RunWriter, this, write, arg);
+
+  // Read the frames into the free frames of the pool
+  int noRead = 0;
+  while (1){
+    PELFrame *frame = queues[0]->Get();
+
+    if (!read(frame->edgeImg, arg)){
+      queues[0]->Put(frame);
+      queues[1]->Put(NULL);
+      break;
+    } //end-if
+
+    frame->frameNo = noRead++;
+    queues[1]->Put(frame);
+  } //end-while
+
+  for (int i=0; i<3; i++) stages[i].join();
+  writer.join();
+
+  // All frames are back in the pool. Empty it for the next run
+  for (int i=0; i<noFrames; i++) queues[0]->Get();
+
+  return noRead;
+} //end-Run
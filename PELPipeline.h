@@ -0,0 +1,88 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _PEL_PIPELINE_H_
+#define _PEL_PIPELINE_H_
+
+#include <mutex>
+#include <condition_variable>
+
+#include "PEL.h"
+
+// A frame in flight: Its edge image & the edgemap it is linked into
+struct PELFrame {
+  int frameNo;              // Position of the frame in the sequence
+  unsigned char *edgeImg;   // width*height edge image (modified by the walk)
+  EdgeMap *map;             // Linked edge segments
+};
+
+///-------------------------------------------------------------------------------
+/// Bounded FIFO of frames between two stages. Put blocks while it is full, Get while it is empty
+///
+struct FrameQueue {
+public:
+  PELFrame **items;
+  int capacity;
+  int head;            // Index of the oldest frame
+  int count;           // # of frames in the queue
+
+  std::mutex lock;
+  std::condition_variable notEmpty, notFull;
+
+public:
+  FrameQueue(int capacity);
+  ~FrameQueue();
+
+  void Put(PELFrame *frame);
+  PELFrame *Get();
+};
+
+// Fills "edgeImg" with the next frame. Returns false at the end of the sequence
+typedef bool (*PELReadFunc)(unsigned char *edgeImg, void *arg);
+
+// Consumes the edgemap of a linked frame. Called in frame order
+typedef void (*PELWriteFunc)(int frameNo, EdgeMap *map, void *arg);
+
+///-------------------------------------------------------------------------------
+/// Pipelined PEL over a sequence of same-sized frames. The stages of PELContext::Link
+/// (walk, join, finish) run on a thread each with a context of their own, reading of the
+/// frames runs on the caller's thread & writing of the results on another thread, so up
+/// to 5 frames are worked on at the same time. A fixed pool of frames circulates through
+/// bounded queues between the stages: Reading blocks when the pool is exhausted, which
+/// bounds the memory & the latency. Each frame is linked exactly as by Link()
+///
+struct PELPipeline {
+public:
+  int width, height;        // Width & height of the frames
+  int MIN_SEGMENT_LEN;
+  int noFrames;             // # of frames in the pool, i.e., at most in flight
+
+  PELFrame *frames;         // Frame pool
+  PELContext *contexts[3];  // Contexts of the walk, join & finish stages
+  FrameQueue *queues[5];    // Free frames -> walk -> join -> finish -> write
+
+public:
+  PELPipeline(int width, int height, int noFrames=4, int MIN_SEGMENT_LEN=10);
+  ~PELPipeline();
+
+  // Link the frames given by "read" & hand them over to "write" in order. "read" & "write"
+  // are called on different threads. Returns the # of frames linked
+  int Run(PELReadFunc read, PELWriteFunc write, void *arg);
+};
+
+#endif
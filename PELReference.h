@@ -0,0 +1,31 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _PEL_REFERENCE_H_
+#define _PEL_REFERENCE_H_
+
+#include "EdgeMap.h"
+
+///-------------------------------------------------------------------------------
+/// The original PEL pipeline, frozen before any optimization, as the reference of PELVerify.
+/// Links a copy of "edgeImg" & returns its segments in an edgemap owned by the caller. The # of
+/// chains of the walk is copied to "noChains" if not NULL
+///
+EdgeMap *PELReference(const unsigned char *edgeImg, int width, int height, int MIN_SEGMENT_LEN=10, int *noChains=NULL);
+
+#endif
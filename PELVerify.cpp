@@ -0,0 +1,894 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "EdgeMap.h"
+#include "PEL.h"
+#include "ChainCode.h"
+#include "ImageIO.h"
+#include "SyntheticEdges.h"
+#include "PELReference.h"
+
+///-------------------------------------------------------------------------------
+/// PEL golden-output harness: Links every edge map of a corpus with the reference, a frozen
+/// copy of the original PEL pipeline (see PELReference.cpp), and with every configuration of
+/// PELContext: The "original" one (scalar FillGaps2 on the edge map, no edgel index, Walk8Dirs,
+/// serial walk, the original per pixel maps of FindJointPoints & JoinNeighborEdgeSegments) and the
+/// optimized variants. It compares the edge segments exactly: same # of segments, and every
+/// segment with the same pixels in the same order. The first divergence of a variant is reported.
+/// The corpus is a set of synthetic maps of every kind plus the given images. A sequence of
+/// frames is also linked by a single context, with & without the segment ownership index wrapping
+/// around, and the direction predictor of the walk is checked against the original one on random
+/// direction sequences. The segments of every map are chain coded & decoded back, as they are &
+/// with empty segments & jumps added (see ChainMap).
+///
+/// Expected divergence: On maps with more than 32767 chains the reference misses joint points, as
+/// its short segment ids wrap around. The owner index fixes that, so the variants with it are
+/// checked against the original configuration with the owner index on those maps, which are listed
+///
+///   PELVerify [-sizes WxH,...] [-seeds N] [-strict] [-save dir] [image.pgm|directory|list.txt ...]
+///
+/// -strict also fails on the variants that are not bit-exact by design (none at present).
+/// -save writes the maps that diverge to the given directory so they can be reproduced.
+/// Exits with 1 if a variant diverged
+///
+
+static const char *defaultSizes = "64x48,257x199,640x480,1023x767,1920x1080";
+
+// How a variant links an edge map
+enum LinkMode {
+  LINK_ONCE,      // A fresh context
+  LINK_REUSED,    // A context that is resized & has linked other maps before
+  LINK_STAGED,    // LinkWalk, LinkJoin & LinkFinish on three contexts as PELPipeline does
+  LINK_REGION,    // LinkRegions on the map placed in a larger, padded image full of edgels
+  LINK_CONST,     // Link on a read-only view of the map placed in a padded image, after another map
+  LINK_BITS       // LinkBits on the map packed to a bit per pixel with padded rows (binary maps only)
+};
+
+// An optimized configuration of PELContext
+struct Variant {
+  const char *name;
+  bool useSIMD, useEdgelIndex, useWalkTable, useBitmap, useEndpointHash, useOwnerIndex;
+  int noThreads;
+  LinkMode mode;
+  bool exact;         // Must the output be identical to the reference?
+
+  int noMaps, noDiverged;
+};
+
+static Variant variants[] = {
+  {"original",       false, false, false, false, false, false, 1,  LINK_ONCE,   true, 0, 0},
+  {"simd",           true,  false, false, false, true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"index",          false, true,  false, false, true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"simd+index",     true,  true,  false, false, true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"table",          false, false, true,  false, true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"simd+index+table", true,  true,  true,  false, true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"reused",         true,  true,  false, false, true,  true,  1,  LINK_REUSED, true, 0, 0},
+  {"staged",         true,  true,  false, false, true,  true,  1,  LINK_STAGED, true, 0, 0},
+  {"region",         true,  true,  false, false, true,  true,  1,  LINK_REGION, true, 0, 0},
+  {"region-scalar",  false, false, false, false, true,  true,  1,  LINK_REGION, true, 0, 0},
+  {"const",          true,  true,  false, false, true,  true,  1,  LINK_CONST,  true, 0, 0},
+  {"const-scalar",   false, false, false, false, true,  true,  1,  LINK_CONST,  true, 0, 0},
+  {"const-table",    true,  false, true,  false, true,  true,  1,  LINK_CONST,  true, 0, 0},
+  {"bitmap",         true,  true,  false, true,  true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"bitmap-table",   true,  true,  true,  true,  true,  true,  1,  LINK_ONCE,   true, 0, 0},
+  {"bitmap-reused",  true,  true,  false, true,  true,  true,  1,  LINK_REUSED, true, 0, 0},
+  {"bitmap-region",  true,  true,  false, true,  true,  true,  1,  LINK_REGION, true, 0, 0},
+  {"bitmap-const",   true,  true,  true,  true,  true,  true,  1,  LINK_CONST,  true, 0, 0},
+  {"bits",           true,  true,  false, true,  true,  true,  1,  LINK_BITS,   true, 0, 0},
+  {"bits-table",     true,  true,  true,  true,  true,  true,  1,  LINK_BITS,   true, 0, 0},
+  {"tiled2",         true,  true,  false, false, true,  true,  2,  LINK_ONCE,   true, 0, 0},
+  {"tiled4",         true,  true,  false, false, true,  true,  4,  LINK_ONCE,   true, 0, 0},
+  {"tiled16",        true,  true,  false, false, true,  true,  16, LINK_ONCE,   true, 0, 0},
+  {"table-tiled4",   true,  true,  true,  false, true,  true,  4,  LINK_ONCE,   true, 0, 0},
+  {"const-tiled2",   true,  true,  false, false, true,  true,  2,  LINK_CONST,  true, 0, 0},
+  {"bitmap-tiled2",  true,  true,  false, true,  true,  true,  2,  LINK_ONCE,   true, 0, 0},
+  {"bits-tiled2",    true,  true,  false, true,  true,  true,  2,  LINK_BITS,   true, 0, 0},
+};
+
+static const int noVariants = sizeof(variants)/sizeof(variants[0]);
+
+static const int MIN_SEGMENT_LEN = 10;
+static const int MAX_SHORT_SEGMENTS = 32767;   // # of segments the short ids of the original FindJointPoints can hold
+
+static bool strict = false;
+static int noRegionErrors = 0;   // # of region links that modified pixels outside their region or resized the context
+static int noConstErrors = 0;    // # of read-only links that modified their image
+static int noPredictErrors = 0;  // # of direction sequences on which the predictor diverged from the reference
+static int noLinkedFrames = 0;   // # of frames linked by one context
+static int noWrappedFrames = 0;  // # of those whose owner index wrapped around
+static int noFrameErrors = 0;    // # of those that diverged from the reference
+static int noOverflowMaps = 0;   // # of maps with more chains than the reference's short segment ids can hold
+static int noExpectedDivergences = 0;   // # of those on which the owner index diverges from the reference
+static int noChainCodeMaps = 0;  // # of edge maps chain coded & decoded back
+static int noChainJumps = 0;     // # of jumps in their chain codes
+static int noEmptySegments = 0;  // # of empty segments in them
+static int noChainCodeErrors = 0;   // # of those that did not decode to their segments
+static const char *saveDir = NULL;
+static int noSaved = 0;
+
+static void ConfigureContext(PELContext *ctx, const Variant *variant);
+static bool VerifyEdgeMap(const char *name, unsigned char *src, int width, int height);
+static EdgeMap *LinkVariant(const Variant *variant, unsigned char *src, int width, int height, int *noChains=NULL);
+static EdgeMap *LinkRegion(const Variant *variant, unsigned char *src, int width, int height);
+static EdgeMap *LinkConst(const Variant *variant, unsigned char *src, int width, int height);
+static EdgeMap *LinkBits(const Variant *variant, unsigned char *src, int width, int height);
+static bool CompareEdgeMaps(EdgeMap *ref, EdgeMap *map, char *msg);
+static bool VerifyChainCode(const char *name, EdgeMap *map);
+static bool CompareChainCode(ChainMap *chain, EdgeMap *map, Pixel *decoded, char *msg);
+static bool VerifyFrames(int noFrames, bool wrap);
+static int VerifyPredictor(int noSequences);
+
+int main(int argc, char **argv){
+  const char *sizes = defaultSizes;
+  int noSeeds = 3;
+  int firstInput = argc;
+
+  for (int i=1; i<argc; i++){
+    if      (strcmp(argv[i], "-sizes") == 0 && i+1 < argc) sizes = argv[++i];
+    else if (strcmp(argv[i], "-seeds") == 0 && i+1 < argc) noSeeds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-save") == 0 && i+1 < argc) saveDir = argv[++i];
+    else if (strcmp(argv[i], "-strict") == 0) strict = true;
+    else if (argv[i][0] == '-'){
+      fprintf(stderr, "Usage: %s [-sizes WxH,...] [-seeds N] [-strict] [-save dir] [image.pgm|directory|list.txt ...]\n", argv[0]);
+      return 1;
+    } else {firstInput = i; break;}
+  } //end-for
+
+  bool ok = true;
+  int noMaps = 0;
+
+  // Direction predictor
+  int noSequences = VerifyPredictor(100000);
+
+  // Synthetic corpus
+  for (const char *str = sizes; *str; ){
+    int width, height, n = 0;
+    if (sscanf(str, "%dx%d%n", &width, &height, &n) != 2 || width < 8 || height < 8){
+      fprintf(stderr, "Invalid size list <%s>\n", sizes);
+      return 1;
+    } //end-if
+
+    str += n;
+    if (*str == ',') str++;
+
+    unsigned char *src = new unsigned char[width*height];
+    for (int k=0; k<=SYNTH_NO_KINDS; k++){
+      // Every kind, then sparse joins maps: Their cells outnumber the slots of the endpoint index, so cells collide
+      SyntheticKind kind = k < SYNTH_NO_KINDS ? (SyntheticKind)k : SYNTH_JOINS;
+      double density = k < SYNTH_NO_KINDS ? SyntheticDensities[k] : 0.002;
+      const char *kindName = k < SYNTH_NO_KINDS ? SyntheticKindNames[k] : "joins-sparse";
+
+      for (int seed=1; seed<=noSeeds; seed++){
+        GenerateEdgeMap(src, width, height, kind, density, seed);
+
+        char name[128];
+        sprintf(name, "%s-%dx%d-%d", kindName, width, height, seed);
+        ok &= VerifyEdgeMap(name, src, width, height);
+        noMaps++;
+      } //end-for
+    } //end-for
+
+    delete[] src;
+  } //end-for
+
+  // A dense map with more chains than the short segment ids of the reference can hold
+  {
+    const int width = 2048, height = 2048;
+    unsigned char *src = new unsigned char[width*height];
+    GenerateEdgeMap(src, width, height, SYNTH_TEXTURE, SyntheticDensities[SYNTH_TEXTURE], 1);
+
+    ok &= VerifyEdgeMap("texture-2048x2048-1", src, width, height);
+    noMaps++;
+    delete[] src;
+  }
+
+  // One context over many frames, as is, then with the owner index forced to wrap around
+  ok &= VerifyFrames(60, false);
+  ok &= VerifyFrames(60, true);
+
+  // Given images
+  for (int i=firstInput; i<argc; i++){
+    char **files = NULL;
+    int noFiles;
+    int len = (int)strlen(argv[i]);
+
+    if (len > 4 && strcmp(argv[i]+len-4, ".pgm") == 0){
+      files = new char *[1];
+      files[0] = new char[len+1];
+      strcpy(files[0], argv[i]);
+      noFiles = 1;
+
+    } else {
+      noFiles = ListInputFiles(argv[i], &files);
+      if (noFiles < 0) return 1;
+    } //end-else
+
+    for (int f=0; f<noFiles; f++){
+      unsigned char *src;
+      int width, height;
+      if (ReadImagePGM(files[f], (char **)&src, &width, &height) == 0){
+        fprintf(stderr, "Failed opening <%s>\n", files[f]);
+        ok = false;
+        continue;
+      } //end-if
+
+      ok &= VerifyEdgeMap(files[f], src, width, height);
+      noMaps++;
+      free(src);
+    } //end-for
+
+    FreeFileList(files, noFiles);
+  } //end-for
+
+  printf("%d edge maps\n", noMaps);
+  for (int v=0; v<noVariants; v++){
+    printf("  %-18s %4d identical, %4d diverged%s\n", variants[v].name, variants[v].noMaps - variants[v].noDiverged, variants[v].noDiverged,
+           variants[v].exact ? "" : " (not bit-exact by design)");
+  } //end-for
+
+  if (noOverflowMaps){
+    printf("%d edge maps with more than %d chains: the owner index diverges from the reference on %d of them as expected,\n"
+           "  & the variants with it are checked against the original configuration with the owner index there\n", noOverflowMaps, MAX_SHORT_SEGMENTS, noExpectedDivergences);
+  } //end-if
+
+  printf("%d frames linked by one context, %d with the owner index wrapped around, %d diverged from the reference\n",
+         noLinkedFrames, noWrappedFrames, noFrameErrors);
+  if (noFrameErrors) ok = false;
+
+  printf("%d edge maps chain coded with %d jumps & %d empty segments, %d did not decode to their segments\n",
+         noChainCodeMaps, noChainJumps, noEmptySegments, noChainCodeErrors);
+  if (noChainCodeErrors) ok = false;
+
+  printf("%d direction sequences, %d diverged from the reference predictor\n", noSequences, noPredictErrors);
+  if (noPredictErrors) ok = false;
+
+  if (noRegionErrors){
+    printf("%d region links modified pixels outside their region or resized the context\n", noRegionErrors);
+    ok = false;
+  } //end-if
+
+  if (noConstErrors){
+    printf("%d read-only links modified their image\n", noConstErrors);
+    ok = false;
+  } //end-if
+
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+} //end-main
+
+///-------------------------------------------------------------------------------
+/// Links "src" with the reference & every variant. Returns false if a variant that must
+/// be exact diverged (any variant with -strict)
+///
+static bool VerifyEdgeMap(const char *name, unsigned char *src, int width, int height){
+  int noChains = 0;
+  EdgeMap *ref = PELReference(src, width, height, MIN_SEGMENT_LEN, &noChains);
+
+  bool ok = VerifyChainCode(name, ref);
+
+  // Past MAX_SHORT_SEGMENTS chains the short segment ids of the reference's FindJointPoints wrap around
+  // & its joint points are missed, which the owner index fixes. The variants with the owner index are
+  // expected to diverge from the reference there, so they are checked against the original
+  // configuration with the owner index
+  EdgeMap *indexRef = NULL;
+  if (noChains > MAX_SHORT_SEGMENTS){
+    Variant indexOriginal = variants[0];
+    indexOriginal.useOwnerIndex = true;
+    indexRef = LinkVariant(&indexOriginal, src, width, height);
+
+    char msg[256];
+    noOverflowMaps++;
+    if (!CompareEdgeMaps(ref, indexRef, msg)){
+      noExpectedDivergences++;
+      printf("%s: %d chains: the owner index diverges from the reference as expected (short segment ids wrap around): %s\n", name, noChains, msg);
+    } //end-if
+  } //end-if
+
+  bool saved = false;
+  for (int v=0; v<noVariants; v++){
+    EdgeMap *map = LinkVariant(&variants[v], src, width, height);
+    if (map == NULL) continue;
+
+    char msg[256];
+    variants[v].noMaps++;
+    if (!CompareEdgeMaps(variants[v].useOwnerIndex && indexRef ? indexRef : ref, map, msg)){
+      variants[v].noDiverged++;
+      printf("%s: %s diverges: %s\n", name, variants[v].name, msg);
+
+      if (variants[v].exact || strict){
+        ok = false;
+
+        if (saveDir && !saved){
+          char filename[512];
+          sprintf(filename, "%s/diverged-%03d.pgm", saveDir, noSaved++);
+          if (SaveImagePGM(filename, (char *)src, width, height)) printf("  saved as <%s>\n", filename);
+          saved = true;
+        } //end-if
+      } //end-if
+    } //end-if
+
+    delete map;
+  } //end-for
+
+  delete ref;
+  delete indexRef;
+  return ok;
+} //end-VerifyEdgeMap
+
+///-------------------------------------------------------------------------------
+/// Sets the options of the variant on the context
+///
+static void ConfigureContext(PELContext *ctx, const Variant *variant){
+  ctx->useSIMD = variant->useSIMD;
+  ctx->useEdgelIndex = variant->useEdgelIndex;
+  ctx->useWalkTable = variant->useWalkTable;
+  ctx->useBitmap = variant->useBitmap;
+  ctx->useEndpointHash = variant->useEndpointHash;
+  ctx->useOwnerIndex = variant->useOwnerIndex;
+  ctx->noThreads = variant->noThreads;
+} //end-ConfigureContext
+
+///-------------------------------------------------------------------------------
+/// Links a copy of "src" with the given variant. The caller owns the returned edgemap.
+/// Returns NULL if the variant does not apply to "src". The # of chains of the walk is
+/// copied to "noChains" if not NULL (LINK_ONCE & LINK_REUSED only)
+///
+static EdgeMap *LinkVariant(const Variant *variant, unsigned char *src, int width, int height, int *noChains){
+  if (variant->mode == LINK_REGION) return LinkRegion(variant, src, width, height);
+  if (variant->mode == LINK_CONST) return LinkConst(variant, src, width, height);
+  if (variant->mode == LINK_BITS) return LinkBits(variant, src, width, height);
+
+  PELContext *contexts[3];
+  int noContexts = variant->mode == LINK_STAGED ? 3 : 1;
+
+  for (int i=0; i<noContexts; i++){
+    if (variant->mode == LINK_REUSED) contexts[i] = new PELContext(width/2+8, height/3+8);
+    else                              contexts[i] = new PELContext(width, height);
+
+    ConfigureContext(contexts[i], variant);
+  } //end-for
+
+  if (variant->mode == LINK_REUSED){
+    // Leave state behind: Link a smaller dense map, then a dense map of the same size
+    int w = contexts[0]->width, h = contexts[0]->height;
+    unsigned char *other = new unsigned char[width*height > w*h ? width*height : w*h];
+
+    GenerateEdgeMap(other, w, h, SYNTH_TEXTURE, 0.3, 99);
+    contexts[0]->Link(other, MIN_SEGMENT_LEN);
+
+    contexts[0]->Resize(width, height);
+    GenerateEdgeMap(other, width, height, SYNTH_TEXTURE, 0.3, 98);
+    contexts[0]->Link(other, MIN_SEGMENT_LEN);
+
+    delete[] other;
+  } //end-if
+
+  unsigned char *edgeImg = new unsigned char[width*height];
+  memcpy(edgeImg, src, width*height);
+
+  EdgeMap *map;
+  if (variant->mode == LINK_STAGED){
+    map = new EdgeMap(width, height);
+    contexts[0]->LinkWalk(edgeImg, map);
+    contexts[1]->LinkJoin(map);
+    contexts[2]->LinkFinish(map, MIN_SEGMENT_LEN);
+
+  } else {
+    contexts[0]->Link(edgeImg, MIN_SEGMENT_LEN);
+    map = contexts[0]->DetachMap();
+    if (noChains) *noChains = contexts[0]->stats.noChains;
+  } //end-else
+
+  delete[] edgeImg;
+  for (int i=0; i<noContexts; i++) delete contexts[i];
+
+  return map;
+} //end-LinkVariant
+
+///-------------------------------------------------------------------------------
+/// Links a copy of "src" as a region of a larger image whose other pixels are all edgels & whose
+/// rows are padded. The segments are moved back to the coordinates of "src", and the pixels
+/// outside the region are checked to be untouched, as is the size of the context, which is
+/// that of the image. The caller owns the returned edgemap
+///
+static EdgeMap *LinkRegion(const Variant *variant, unsigned char *src, int width, int height){
+  const int x0 = 13, y0 = 3;
+  int imageWidth = width + 29;
+  int imageHeight = height + 6;
+  int stride = imageWidth + 3;
+
+  unsigned char *image = new unsigned char[stride*imageHeight];
+  memset(image, 255, stride*imageHeight);
+  for (int i=0; i<height; i++) memcpy(image + (y0+i)*stride + x0, src + i*width, width);
+
+  PELContext ctx(imageWidth, imageHeight);
+  ConfigureContext(&ctx, variant);
+
+  PELRect region = {x0, y0, width, height};
+  EdgeMap *regionMap = ctx.LinkRegions(image, imageWidth, imageHeight, stride, &region, 1, MIN_SEGMENT_LEN);
+
+  if (ctx.width != imageWidth || ctx.height != imageHeight){
+    printf("%s: the context is left %dx%d instead of %dx%d\n", variant->name, ctx.width, ctx.height, imageWidth, imageHeight);
+    noRegionErrors++;
+  } //end-if
+
+  for (int r=0; r<imageHeight; r++){
+    for (int c=0; c<stride; c++){
+      bool inside = r >= y0 && r < y0+height && c >= x0 && c < x0+width;
+      if (!inside && image[r*stride+c] != 255){
+        printf("%s: pixel (%d, %d) outside the region was modified\n", variant->name, r, c);
+        noRegionErrors++;
+        r = imageHeight;
+        break;
+      } //end-if
+    } //end-for
+  } //end-for
+
+  int noPixels = 0;
+  for (int i=0; i<regionMap->noSegments; i++) noPixels += regionMap->segments[i].noPixels;
+
+  EdgeMap *map = new EdgeMap(width, height, noPixels, regionMap->noSegments);
+  Pixel *pixels = map->pixels;
+  for (int i=0; i<regionMap->noSegments; i++){
+    map->segments[i].pixels = pixels;
+    map->segments[i].noPixels = regionMap->segments[i].noPixels;
+
+    for (int j=0; j<regionMap->segments[i].noPixels; j++){
+      pixels[j].r = regionMap->segments[i].pixels[j].r - y0;
+      pixels[j].c = regionMap->segments[i].pixels[j].c - x0;
+    } //end-for
+
+    pixels += regionMap->segments[i].noPixels;
+  } //end-for
+  map->noSegments = regionMap->noSegments;
+
+  delete[] image;
+  return map;
+} //end-LinkRegion
+
+///-------------------------------------------------------------------------------
+/// Links "src" through the read-only API as a view into a padded image, after the same context
+/// has linked a dense map, so the edgel bitmap holds the state of another frame. The image is
+/// checked to be untouched. The caller owns the returned edgemap
+///
+static EdgeMap *LinkConst(const Variant *variant, unsigned char *src, int width, int height){
+  const int x0 = 5;
+  int stride = width + 11;
+
+  unsigned char *image = new unsigned char[stride*height];
+  memset(image, 255, stride*height);
+  for (int i=0; i<height; i++) memcpy(image + i*stride + x0, src + i*width, width);
+
+  unsigned char *copy = new unsigned char[stride*height];
+  memcpy(copy, image, stride*height);
+
+  PELContext ctx(width, height);
+  ConfigureContext(&ctx, variant);
+
+  unsigned char *other = new unsigned char[width*height];
+  GenerateEdgeMap(other, width, height, SYNTH_TEXTURE, 0.3, 97);
+  ctx.Link((const unsigned char *)other, MIN_SEGMENT_LEN);
+  delete[] other;
+
+  ctx.Link((const unsigned char *)(image + x0), MIN_SEGMENT_LEN, stride);
+  EdgeMap *map = ctx.DetachMap();
+
+  if (memcmp(image, copy, stride*height) != 0){
+    printf("%s: the read-only image was modified\n", variant->name);
+    noConstErrors++;
+  } //end-if
+
+  delete[] image;
+  delete[] copy;
+  return map;
+} //end-LinkConst
+
+///-------------------------------------------------------------------------------
+/// Links "src" packed as a PBM image, 8 pixels per byte with the leftmost in the most significant
+/// bit, with rows padded to a stride of a few more bytes & garbage in the padding. The packed form
+/// has no weak edgels, so the maps with pixels other than 0 & 255 are skipped: Returns NULL for them.
+/// The caller owns the returned edgemap
+///
+static EdgeMap *LinkBits(const Variant *variant, unsigned char *src, int width, int height){
+  for (int i=0; i<width*height; i++) if (src[i] != 0 && src[i] != 255) return NULL;
+
+  int stride = (width+7)/8 + 3;
+  unsigned char *bits = new unsigned char[stride*height];
+  memset(bits, 0xA5, stride*height);
+
+  for (int r=0; r<height; r++){
+    unsigned char *row = bits + r*stride;
+    for (int c=0; c<width; c+=8){
+      unsigned char byte = c+8 <= width ? 0 : 0xff >> (width-c);   // Set the bits past the width
+      for (int k=0; k<8 && c+k<width; k++) if (src[r*width+c+k]) byte |= 0x80 >> k;
+      row[c/8] = byte;
+    } //end-for
+  } //end-for
+
+  PELContext ctx(width, height);
+  ConfigureContext(&ctx, variant);
+
+  ctx.LinkBits(bits, MIN_SEGMENT_LEN, stride);
+  EdgeMap *map = ctx.DetachMap();
+
+  delete[] bits;
+  return map;
+} //end-LinkBits
+
+///-------------------------------------------------------------------------------
+/// Are the edge segments of the two maps identical? If not, the first divergence is described in "msg"
+///
+static bool CompareEdgeMaps(EdgeMap *ref, EdgeMap *map, char *msg){
+  int noSegments = ref->noSegments < map->noSegments ? ref->noSegments : map->noSegments;
+
+  for (int i=0; i<noSegments; i++){
+    EdgeSegment *a = &ref->segments[i];
+    EdgeSegment *b = &map->segments[i];
+    int noPixels = a->noPixels < b->noPixels ? a->noPixels : b->noPixels;
+
+    for (int j=0; j<noPixels; j++){
+      if (a->pixels[j].r != b->pixels[j].r || a->pixels[j].c != b->pixels[j].c){
+        sprintf(msg, "segment %d pixel %d is (%d, %d) instead of (%d, %d)", i, j,
+                b->pixels[j].r, b->pixels[j].c, a->pixels[j].r, a->pixels[j].c);
+        return false;
+      } //end-if
+    } //end-for
+
+    if (a->noPixels != b->noPixels){
+      sprintf(msg, "segment %d has %d pixels instead of %d", i, b->noPixels, a->noPixels);
+      return false;
+    } //end-if
+  } //end-for
+
+  if (ref->noSegments != map->noSegments){
+    sprintf(msg, "%d segments instead of %d", map->noSegments, ref->noSegments);
+    return false;
+  } //end-if
+
+  return true;
+} //end-CompareEdgeMaps
+
+///-------------------------------------------------------------------------------
+/// Chain codes the segments of "map" & decodes them back with both Decode & ChainCursor, as they
+/// are, then with an empty segment at both ends & before every 4th segment, and with every 3rd
+/// segment followed by the pixels of the next one in reverse, which are mostly stored as jumps.
+/// Returns false if a segment did not decode to its pixels
+///
+static bool VerifyChainCode(const char *name, EdgeMap *map){
+  static ChainMap chain;    // Shared by all the maps, so Encode re-uses its storage
+
+  int noPixels = 0;
+  for (int i=0; i<map->noSegments; i++) noPixels += map->segments[i].noPixels;
+
+  EdgeMap *gapped = new EdgeMap(map->width, map->height, 2*noPixels+1, 2*map->noSegments+3);
+  Pixel *p = gapped->pixels;
+  int k = 0;
+
+  gapped->segments[k].pixels = p;
+  gapped->segments[k++].noPixels = 0;
+
+  for (int i=0; i<map->noSegments; i++){
+    EdgeSegment *segment = &map->segments[i];
+
+    if (i % 4 == 1){
+      gapped->segments[k].pixels = p;
+      gapped->segments[k++].noPixels = 0;
+    } //end-if
+
+    EdgeSegment *joined = &gapped->segments[k++];
+    joined->pixels = p;
+    memcpy(p, segment->pixels, sizeof(Pixel)*segment->noPixels);
+    p += segment->noPixels;
+
+    if (i % 3 == 0 && i+1 < map->noSegments){
+      EdgeSegment *next = &map->segments[i+1];
+      for (int j=next->noPixels-1; j>=0; j--) *p++ = next->pixels[j];
+    } //end-if
+
+    joined->noPixels = (int)(p - joined->pixels);
+  } //end-for
+
+  gapped->segments[k].pixels = p;
+  gapped->segments[k++].noPixels = 0;
+  gapped->noSegments = k;
+
+  Pixel *decoded = new Pixel[2*noPixels+1];
+  char msg[256];
+  bool ok = true;
+
+  EdgeMap *maps[2] = {map, gapped};
+  for (int m=0; m<2; m++){
+    chain.Encode(maps[m]);
+
+    noChainCodeMaps++;
+    noChainJumps += chain.jumpOffsets[chain.noSegments];
+    for (int i=0; i<maps[m]->noSegments; i++) if (maps[m]->segments[i].noPixels == 0) noEmptySegments++;
+
+    if (!CompareChainCode(&chain, maps[m], decoded, msg)){
+      noChainCodeErrors++;
+      printf("%s: the chain code of the %s segments does not decode to them: %s\n", name, m ? "gapped" : "linked", msg);
+      ok = false;
+    } //end-if
+  } //end-for
+
+  delete[] decoded;
+  delete gapped;
+  return ok;
+} //end-VerifyChainCode
+
+///-------------------------------------------------------------------------------
+/// Compares every segment of "chain" decoded into "decoded" & pixel by pixel with a cursor to the
+/// segments of "map". Returns false with the first difference in "msg"
+///
+static bool CompareChainCode(ChainMap *chain, EdgeMap *map, Pixel *decoded, char *msg){
+  if (chain->noSegments != map->noSegments){
+    sprintf(msg, "%d segments instead of %d", chain->noSegments, map->noSegments);
+    return false;
+  } //end-if
+
+  for (int i=0; i<map->noSegments; i++){
+    EdgeSegment *segment = &map->segments[i];
+
+    if (chain->SegmentLength(i) != segment->noPixels){
+      sprintf(msg, "segment %d has %d pixels instead of %d", i, chain->SegmentLength(i), segment->noPixels);
+      return false;
+    } //end-if
+
+    chain->Decode(i, decoded);
+
+    ChainCursor cursor(chain, i);
+    Pixel pixel;
+    int j = 0;
+    for (; cursor.Next(&pixel); j++){
+      if (j >= segment->noPixels){
+        sprintf(msg, "the cursor walks past the %d pixels of segment %d", segment->noPixels, i);
+        return false;
+      } //end-if
+
+      Pixel *a = &segment->pixels[j];
+      if (decoded[j].r != a->r || decoded[j].c != a->c || pixel.r != a->r || pixel.c != a->c){
+        sprintf(msg, "segment %d pixel %d decodes to (%d, %d) & walks to (%d, %d) instead of (%d, %d)", i, j,
+                decoded[j].r, decoded[j].c, pixel.r, pixel.c, a->r, a->c);
+        return false;
+      } //end-if
+    } //end-for
+
+    if (j != segment->noPixels){
+      sprintf(msg, "the cursor stops after %d of the %d pixels of segment %d", j, segment->noPixels, i);
+      return false;
+    } //end-if
+  } //end-for
+
+  return true;
+} //end-CompareChainCode
+
+///-------------------------------------------------------------------------------
+/// Links "noFrames" synthetic maps of every kind & of several sizes one after the other with a
+/// single context, as a video does, so that the segment ownership index holds the entries of the
+/// previous frames, and compares each with the reference. With "wrap", the owner
+/// base of the context is moved up to a few values below INT_MAX every third frame, so the index
+/// wraps around & is cleared within a frame or two. Returns false if a frame diverged, or if no
+/// frame wrapped around with "wrap"
+///
+static bool VerifyFrames(int noFrames, bool wrap){
+  static const int sizes[][2] = {{64, 48}, {257, 199}, {640, 480}, {123, 301}};
+  const int noSizes = sizeof(sizes)/sizeof(sizes[0]);
+
+  Variant optimized = {"frames", true, true, false, true, true, true, 1, LINK_ONCE, true, 0, 0};
+
+  PELContext ctx(sizes[0][0], sizes[0][1]);
+  ConfigureContext(&ctx, &optimized);
+
+  unsigned char *src = new unsigned char[640*480];
+  unsigned char *edgeImg = new unsigned char[640*480];
+  int noWrapped = 0, noErrors = 0;
+
+  for (int f=0; f<noFrames; f++){
+    int width = sizes[f%noSizes][0];
+    int height = sizes[f%noSizes][1];
+    int kind = (f/noSizes) % SYNTH_NO_KINDS;
+
+    GenerateEdgeMap(src, width, height, (SyntheticKind)kind, SyntheticDensities[kind], 1000+f);
+    memcpy(edgeImg, src, width*height);
+
+    if (wrap && f%3 == 0) ctx.ownerBase = INT_MAX - 50;
+    int ownerBase = ctx.ownerBase;
+
+    ctx.Resize(width, height);
+    EdgeMap *map = ctx.Link(edgeImg, MIN_SEGMENT_LEN);
+    if (ctx.ownerBase < ownerBase) noWrapped++;
+
+    EdgeMap *ref = PELReference(src, width, height, MIN_SEGMENT_LEN);
+
+    char msg[256];
+    if (!CompareEdgeMaps(ref, map, msg)){
+      if (noErrors++ == 0) printf("Frame %d (%s %dx%d, %s) diverges: %s\n", f, SyntheticKindNames[kind], width, height, wrap ? "wrapped" : "as is", msg);
+    } //end-if
+
+    delete ref;
+  } //end-for
+
+  delete[] src;
+  delete[] edgeImg;
+
+  noLinkedFrames += noFrames;
+  noWrappedFrames += noWrapped;
+  noFrameErrors += noErrors;
+
+  return noErrors == 0 && (!wrap || noWrapped > 0);
+} //end-VerifyFrames
+
+///======================================= Direction predictor =======================================
+#define UP_LEFT    1
+#define UP         2
+#define UP_RIGHT   3
+#define RIGHT      4
+#define DOWN_RIGHT 5
+#define DOWN       6
+#define DOWN_LEFT  7
+#define LEFT       8
+
+///-------------------------------------------------------------------------------
+/// The original predictor of Walk8Dirs: Counts the votes of the last 8 directions for each
+/// prediction. PELPredictDirs must make the same prediction after every direction
+///
+struct RefQueue {
+#define QSIZE 8
+  int Q[QSIZE];
+  int noItems;
+  int rear;
+
+  RefQueue(){noItems = 0; rear = 0;}
+
+  void Add(int dir){
+    Q[rear++] = dir;
+    if (rear >= QSIZE) rear = 0;
+    if (noItems < QSIZE) noItems++;
+  } //end-add
+
+  int ComputeNextDir(int analysisDir){
+    int C[2] = {0, 0};
+
+    if (analysisDir == LEFT || analysisDir == RIGHT){
+      // LEFT or RIGHT
+      for (int i=0; i<noItems; i++){
+        if (Q[i] == UP || Q[i] == DOWN) continue;
+
+        if (Q[i] == LEFT || Q[i] == DOWN_LEFT || Q[i] == UP_LEFT) C[0]++;
+        else                                                      C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return LEFT;
+      else              return RIGHT;
+
+    } else if (analysisDir == UP || analysisDir == DOWN){
+      // UP or DOWN
+      for (int i=0; i<noItems; i++){
+        if (Q[i] == LEFT || Q[i] == RIGHT) continue;
+
+        if (Q[i] == UP || Q[i] == UP_LEFT || Q[i] == UP_RIGHT) C[0]++;
+        else                                                   C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return UP;
+      else              return DOWN;
+
+    } else if (analysisDir == UP_LEFT){
+      // UP or LEFT
+      for (int i=0; i<noItems; i++){
+        if      (Q[i] == UP)   C[0]++;
+        else if (Q[i] == LEFT) C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return UP;
+      else              return LEFT;
+
+    } else if (analysisDir == UP_RIGHT){
+      // UP or RIGHT
+      for (int i=0; i<noItems; i++){
+        if      (Q[i] == UP)    C[0]++;
+        else if (Q[i] == RIGHT) C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return UP;
+      else              return RIGHT;
+
+    } else if (analysisDir == DOWN_RIGHT){
+      // DOWN or RIGHT
+      for (int i=0; i<noItems; i++){
+        if      (Q[i] == DOWN)  C[0]++;
+        else if (Q[i] == RIGHT) C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return DOWN;
+      else              return RIGHT;
+
+    } else { //if (analysisDir == DOWN_LEFT){
+      // DOWN or LEFT
+      for (int i=0; i<noItems; i++){
+        if      (Q[i] == DOWN) C[0]++;
+        else if (Q[i] == LEFT) C[1]++;
+      } //end-for
+
+      if (C[0] >= C[1]) return DOWN;
+      else              return LEFT;
+    } // end-else
+  } //end-ComputeNextDir
+};
+
+///-------------------------------------------------------------------------------
+/// Feeds random direction sequences of up to 40 directions to PELPredictDirs & to the
+/// reference predictor, and compares every prediction. Half of the sequences draw from only
+/// 2 or 3 directions, as along a real edge, so that ties & long runs are common.
+/// Returns the # of sequences checked
+///
+static int VerifyPredictor(int noSequences){
+  const int MAX_LEN = 40;
+  int dirs[MAX_LEN], nextDirs[8*MAX_LEN];
+  unsigned int state = 2463534242u;   // xorshift32
+
+  for (int s=0; s<noSequences; s++){
+    int choices[8], noChoices = 8;
+    for (int d=0; d<8; d++) choices[d] = d+1;
+
+    state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+    int len = state % (MAX_LEN+1);
+    if (s & 1){
+      state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+      noChoices = 2 + state%2;
+      for (int d=0; d<noChoices; d++){
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        choices[d] = 1 + state%8;
+      } //end-for
+    } //end-if
+
+    for (int i=0; i<len; i++){
+      state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+      dirs[i] = choices[state % noChoices];
+    } //end-for
+
+    PELPredictDirs(dirs, len, nextDirs);
+
+    RefQueue Q;
+    for (int i=0; i<len; i++){
+      Q.Add(dirs[i]);
+
+      int analysisDir;
+      for (analysisDir=UP_LEFT; analysisDir<=LEFT; analysisDir++){
+        if (nextDirs[8*i+analysisDir-1] != Q.ComputeNextDir(analysisDir)) break;
+      } //end-for
+
+      if (analysisDir <= LEFT){
+        if (noPredictErrors++ == 0){
+          printf("Predictor diverges after direction %d of the sequence", i);
+          for (int k=0; k<=i; k++) printf(" %d", dirs[k]);
+          printf(" for analysis direction %d: %d instead of %d\n", analysisDir, nextDirs[8*i+analysisDir-1], Q.ComputeNextDir(analysisDir));
+        } //end-if
+
+        break;
+      } //end-if
+    } //end-for
+  } //end-for
+
+  return noSequences;
+} //end-VerifyPredictor
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "ImageIO.h"
+#include "SegmentFile.h"
+
+// Offset of a section rounded up to 8 bytes
+static long long AlignSection(long long offset){
+  return (offset + 7) & ~7LL;
+} //end-AlignSection
+
+///-------------------------------------------------------------------------------
+/// Write a segment file. The offsets are the running sums of the segment lengths &
+/// the pixels of each segment are written with a single fwrite from the edgemap
+///
+bool SaveSegmentFile(const char *filename, EdgeMap *map){
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL){
+    fprintf(stderr, "Error writing the segment file %s.\n", filename);
+    return false;
+  } //end-if
+
+  SegmentFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "PELS", 4);
+  header.byteOrder = SEGMENT_FILE_BYTE_ORDER;
+  header.version = SEGMENT_FILE_VERSION;
+  header.pixelSize = sizeof(Pixel);
+  header.width = map->width;
+  header.height = map->height;
+  header.noSegments = map->noSegments;
+
+  for (int i=0; i<map->noSegments; i++) header.noPixels += map->segments[i].noPixels;
+
+  header.offsetsOffset = AlignSection(sizeof(header));
+  header.pixelsOffset = AlignSection(header.offsetsOffset + sizeof(int)*(map->noSegments+1));
+
+  static const char zeros[8] = {0};
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  ok = ok && fwrite(zeros, 1, (size_t)(header.offsetsOffset - sizeof(header)), fp) == (size_t)(header.offsetsOffset - sizeof(header));
+
+  int offset = 0;
+  for (int i=0; i<=map->noSegments && ok; i++){
+    ok = fwrite(&offset, sizeof(int), 1, fp) == 1;
+    if (i < map->noSegments) offset += map->segments[i].noPixels;
+  } //end-for
+
+  long long end = header.offsetsOffset + sizeof(int)*(map->noSegments+1);
+  ok = ok && fwrite(zeros, 1, (size_t)(header.pixelsOffset - end), fp) == (size_t)(header.pixelsOffset - end);
+
+  for (int i=0; i<map->noSegments && ok; i++){
+    int len = map->segments[i].noPixels;
+    ok = fwrite(map->segments[i].pixels, sizeof(Pixel), len, fp) == (size_t)len;
+  } //end-for
+
+  if (fclose(fp) != 0) ok = false;
+  if (!ok) fprintf(stderr, "Error writing the segment file %s.\n", filename);
+
+  return ok;
+} //end-SaveSegmentFile
+
+SegmentFile::SegmentFile(){
+  width = height = 0;
+  noSegments = noPixels = 0;
+  offsets = NULL;
+  pixels = NULL;
+
+  data = NULL;
+  size = 0;
+  handle = NULL;
+} //end-SegmentFile
+
+SegmentFile::~SegmentFile(){
+  Close();
+} //end-~SegmentFile
+
+void SegmentFile::Close(){
+  if (data) UnmapFile(data, size, handle);
+
+  data = NULL;
+  size = 0;
+  handle = NULL;
+  offsets = NULL;
+  pixels = NULL;
+  noSegments = noPixels = 0;
+} //end-Close
+
+///-------------------------------------------------------------------------------
+/// Map a segment file. The header & the offset table are validated against the file size,
+/// so every segment of an opened file lies within the mapping
+///
+bool SegmentFile::Open(const char *filename){
+  Close();
+
+  data = MapFile(filename, &size, &handle);
+  if (data == NULL){
+    fprintf(stderr, "Error opening the segment file %s.\n", filename);
+    return false;
+  } //end-if
+
+  const SegmentFileHeader *header = (const SegmentFileHeader *)data;
+  bool ok = size >= sizeof(SegmentFileHeader) && memcmp(header->magic, "PELS", 4) == 0;
+
+  if (ok && (header->byteOrder != SEGMENT_FILE_BYTE_ORDER || header->version != SEGMENT_FILE_VERSION || header->pixelSize != sizeof(Pixel))){
+    fprintf(stderr, "The segment file %s was written with a different byte order, version or pixel layout.\n", filename);
+    Close();
+    return false;
+  } //end-if
+
+  ok = ok && header->noSegments >= 0 && header->noPixels >= 0 &&
+       header->offsetsOffset >= (long long)sizeof(SegmentFileHeader) && (header->offsetsOffset & 7) == 0 &&
+       header->offsetsOffset + (long long)sizeof(int)*(header->noSegments+1) <= header->pixelsOffset && (header->pixelsOffset & 7) == 0 &&
+       header->pixelsOffset + (long long)sizeof(Pixel)*header->noPixels <= (long long)size;
+
+  if (ok){
+    offsets = (const int *)((const char *)data + header->offsetsOffset);
+    pixels = (const Pixel *)((const char *)data + header->pixelsOffset);
+
+    ok = offsets[0] == 0 && offsets[header->noSegments] == header->noPixels;
+    for (int i=0; i<header->noSegments && ok; i++) ok = offsets[i] <= offsets[i+1];
+  } //end-if
+
+  if (!ok){
+    fprintf(stderr, "The file %s is not a valid segment file.\n", filename);
+    Close();
+    return false;
+  } //end-if
+
+  width = header->width;
+  height = header->height;
+  noSegments = header->noSegments;
+  noPixels = header->noPixels;
+
+  return true;
+} //end-Open
@@ -0,0 +1,75 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _SEGMENT_FILE_H_
+#define _SEGMENT_FILE_H_
+
+#include "EdgeMap.h"
+
+#define SEGMENT_FILE_VERSION    1
+#define SEGMENT_FILE_BYTE_ORDER 0x01020304
+
+///-------------------------------------------------------------------------------
+/// Binary segment file: The header, a table of noSegments+1 pixel offsets (segment i
+/// is pixels [offsets[i], offsets[i+1])) & the packed Pixel array, each section 8 byte
+/// aligned. Pixels are stored in the in-memory Pixel layout & the host byte order, so a
+/// mapped file is used as is with no parsing
+///
+struct SegmentFileHeader {
+  char magic[4];                // "PELS"
+  unsigned int byteOrder;       // SEGMENT_FILE_BYTE_ORDER as written by the host
+  unsigned int version;         // SEGMENT_FILE_VERSION
+  unsigned int pixelSize;       // sizeof(Pixel)
+  int width, height;            // Width & height of the image
+  int noSegments;
+  int noPixels;                 // Total # of pixels of all segments
+  long long offsetsOffset;      // File offset of the segment offset table
+  long long pixelsOffset;       // File offset of the pixel array
+};
+
+// Write the edge segments of "map" straight from its arrays. Returns false on failure
+bool SaveSegmentFile(const char *filename, EdgeMap *map);
+
+///-------------------------------------------------------------------------------
+/// Read-only view of a mapped segment file
+///
+struct SegmentFile {
+public:
+  int width, height;
+  int noSegments;
+  int noPixels;
+  const int *offsets;       // noSegments+1 pixel offsets
+  const Pixel *pixels;      // noPixels pixels
+
+  void *data;               // Mapped file
+  size_t size;
+  void *handle;
+
+public:
+  SegmentFile();
+  ~SegmentFile();
+
+  // Map & validate a segment file. Returns false on failure
+  bool Open(const char *filename);
+  void Close();
+
+  int SegmentLength(int i){return offsets[i+1] - offsets[i];}
+  const Pixel *SegmentPixels(int i){return pixels + offsets[i];}
+};
+
+#endif
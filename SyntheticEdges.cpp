@@ -0,0 +1,173 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#include <string.h>
+
+#include "SyntheticEdges.h"
+
+const char *SyntheticKindNames[SYNTH_NO_KINDS] = {"lines", "circles", "speckle", "texture", "gaps", "joins"};
+const double SyntheticDensities[SYNTH_NO_KINDS] = {0.03, 0.03, 0.02, 0.25, 0.03, 0.03};
+
+///-------------------------------------------------------------------------------
+/// Random number generator of the maps (xorshift32), so that they do not depend on rand()
+///
+struct SynthRandom {
+  unsigned int state;
+
+  SynthRandom(unsigned int seed){state = seed*2654435761u + 1; if (state == 0) state = 1;}
+
+  // Returns a random number in [0, n)
+  int Next(int n){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return (int)(state % (unsigned int)n);
+  } //end-Next
+};
+
+///-------------------------------------------------------------------------------
+/// Marks an edgel. Returns 1 if the pixel was empty
+///
+static inline int SetEdgel(unsigned char *edgeImg, int width, int height, int r, int c){
+  if (r < 0 || r >= height || c < 0 || c >= width) return 0;
+  if (edgeImg[r*width+c]) return 0;
+
+  edgeImg[r*width+c] = 255;
+  return 1;
+} //end-SetEdgel
+
+///-------------------------------------------------------------------------------
+/// Draws a line from (r0, c0) to (r1, c1) by Bresenham's algorithm. If gap > 0 every gap-th
+/// pixel is skipped. Returns the # of new edgels
+///
+static int DrawLine(unsigned char *edgeImg, int width, int height, int r0, int c0, int r1, int c1, int gap){
+  int dc = c1 > c0 ? c1-c0 : c0-c1;
+  int dr = r1 > r0 ? r0-r1 : r1-r0;
+  int sc = c0 < c1 ? 1 : -1;
+  int sr = r0 < r1 ? 1 : -1;
+  int err = dc+dr;
+  int noEdgels = 0;
+
+  for (int k=0; ; k++){
+    if (gap == 0 || k%gap != gap-1) noEdgels += SetEdgel(edgeImg, width, height, r0, c0);
+    if (r0 == r1 && c0 == c1) break;
+
+    int e2 = 2*err;
+    if (e2 >= dr){err += dr; c0 += sc;}
+    if (e2 <= dc){err += dc; r0 += sr;}
+  } //end-for
+
+  return noEdgels;
+} //end-DrawLine
+
+///-------------------------------------------------------------------------------
+/// Draws a circle of the given radius by the midpoint algorithm. Returns the # of new edgels
+///
+static int DrawCircle(unsigned char *edgeImg, int width, int height, int cr, int cc, int radius){
+  int r = 0;
+  int c = radius;
+  int err = 1-radius;
+  int noEdgels = 0;
+
+  while (r <= c){
+    noEdgels += SetEdgel(edgeImg, width, height, cr+r, cc+c) + SetEdgel(edgeImg, width, height, cr+r, cc-c);
+    noEdgels += SetEdgel(edgeImg, width, height, cr-r, cc+c) + SetEdgel(edgeImg, width, height, cr-r, cc-c);
+    noEdgels += SetEdgel(edgeImg, width, height, cr+c, cc+r) + SetEdgel(edgeImg, width, height, cr+c, cc-r);
+    noEdgels += SetEdgel(edgeImg, width, height, cr-c, cc+r) + SetEdgel(edgeImg, width, height, cr-c, cc-r);
+
+    r++;
+    if (err < 0) err += 2*r+1;
+    else {c--; err += 2*(r-c)+1;}
+  } //end-while
+
+  return noEdgels;
+} //end-DrawCircle
+
+///-------------------------------------------------------------------------------
+/// Draws primitives of the given kind until the target # of edgels is reached
+///
+int GenerateEdgeMap(unsigned char *edgeImg, int width, int height, SyntheticKind kind, double density, unsigned int seed){
+  memset(edgeImg, 0, width*height);
+
+  SynthRandom rnd(seed);
+  int target = (int)(density*width*height);
+  int maxLen = width > height ? width : height;
+  int noEdgels = 0;
+
+  // Every primitive adds at least one edgel in a few tries, so bound the # of draws
+  for (int tries=0; noEdgels < target && tries < 4*width*height; tries++){
+    switch (kind){
+      case SYNTH_LINES: {
+        int r0 = rnd.Next(height), c0 = rnd.Next(width);
+        int len = 8 + rnd.Next(maxLen/4+1);
+        noEdgels += DrawLine(edgeImg, width, height, r0, c0, r0+rnd.Next(2*len+1)-len, c0+rnd.Next(2*len+1)-len, 0);
+        break;
+      } //end-case
+
+      case SYNTH_CIRCLES: {
+        int radius = 4 + rnd.Next(maxLen/8+1);
+        noEdgels += DrawCircle(edgeImg, width, height, rnd.Next(height), rnd.Next(width), radius);
+        break;
+      } //end-case
+
+      case SYNTH_SPECKLE:
+        noEdgels += SetEdgel(edgeImg, width, height, rnd.Next(height), rnd.Next(width));
+        break;
+
+      case SYNTH_TEXTURE: {
+        // A short polyline of 2 to 4 pieces turning randomly
+        int r = rnd.Next(height), c = rnd.Next(width);
+        int noPieces = 2 + rnd.Next(3);
+        for (int k=0; k<noPieces; k++){
+          int r1 = r + rnd.Next(15) - 7;
+          int c1 = c + rnd.Next(15) - 7;
+          noEdgels += DrawLine(edgeImg, width, height, r, c, r1, c1, 0);
+          r = r1; c = c1;
+        } //end-for
+        break;
+      } //end-case
+
+      case SYNTH_JOINS: {
+        // 2 to 4 lines going away from the top-left pixel of a cell, each starting at most 2 pixels
+        // from it, so the tips 1 to 3 pixels apart are in the same or in neighboring cells
+        int r = 8*rnd.Next(height/8+1), c = 8*rnd.Next(width/8+1);
+        int noLines = 2 + rnd.Next(3);
+        for (int k=0; k<noLines; k++){
+          int sr = rnd.Next(4) - 2;
+          int sc = rnd.Next(4) - 2;
+          int len = 4 + rnd.Next(17);
+          int r0 = r + sr, c0 = c + sc;
+          int r1 = r0 + (sr >= 0 ? rnd.Next(len+1) : -rnd.Next(len+1));
+          int c1 = c0 + (sc >= 0 ? rnd.Next(len+1) : -rnd.Next(len+1));
+          noEdgels += DrawLine(edgeImg, width, height, r0, c0, r1, c1, 0);
+        } //end-for
+        break;
+      } //end-case
+
+      default: {
+        int r0 = rnd.Next(height), c0 = rnd.Next(width);
+        int len = 8 + rnd.Next(maxLen/4+1);
+        noEdgels += DrawLine(edgeImg, width, height, r0, c0, r0+rnd.Next(2*len+1)-len, c0+rnd.Next(2*len+1)-len, 6 + rnd.Next(6));
+        break;
+      } //end-default
+    } //end-switch
+  } //end-for
+
+  return noEdgels;
+} //end-GenerateEdgeMap
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * PEL: Predictive Edge Linking
+ * 
+ * Copyright 2015 Cuneyt Akinlar (cakinlar@anadolu.edu.tr)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+#ifndef _SYNTHETIC_EDGES_H_
+#define _SYNTHETIC_EDGES_H_
+
+// Kinds of synthetic binary edge maps
+enum SyntheticKind {
+  SYNTH_LINES,      // Random straight lines
+  SYNTH_CIRCLES,    // Random circles
+  SYNTH_SPECKLE,    // Isolated noise edgels
+  SYNTH_TEXTURE,    // Dense short random curves
+  SYNTH_GAPS,       // Random lines broken by 1 pixel gaps every few pixels (exercises FillGaps)
+  SYNTH_JOINS,      // Short lines whose tips are 2 pixels apart around the corners of 8x8 pixel cells (exercises the join)
+  SYNTH_NO_KINDS
+};
+
+extern const char *SyntheticKindNames[SYNTH_NO_KINDS];
+
+// Fraction of the pixels set by default for each kind
+extern const double SyntheticDensities[SYNTH_NO_KINDS];
+
+///-------------------------------------------------------------------------------
+/// Fills the width x height "edgeImg" with a binary edge map (0/255) of the given kind
+/// having approximately density*width*height edgels. The map depends only on the
+/// arguments, so the same seed gives the same map on every platform.
+/// Returns the # of edgels
+///
+int GenerateEdgeMap(unsigned char *edgeImg, int width, int height, SyntheticKind kind, double density, unsigned int seed);
+
+#endif
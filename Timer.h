@@ -1,33 +1,42 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
-#include <windows.h>
+#include <chrono>
 
+///-------------------------------------------------------------------------------
+/// Hi-res timer on the monotonic clock of the C++ standard library, so it builds on
+/// every platform (it is QueryPerformanceCounter on Windows & clock_gettime elsewhere)
+///
 class Timer {
 private:
-  __int64 freq, tStart, tStop;
+  std::chrono::steady_clock::time_point tStart, tStop;
 
 public:
   Timer(){
-    // Get the frequency of the hi-res timer
-    QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+    tStart = tStop = std::chrono::steady_clock::now();
   } //end-TimerClass
 
   void Start(){
-    // Use hi-res timer
-    QueryPerformanceCounter((LARGE_INTEGER*)&tStart);
+    tStart = std::chrono::steady_clock::now();
   } //end-Start
 
   void Stop(){
-    // Perform operations that require timing
-    QueryPerformanceCounter((LARGE_INTEGER*)&tStop);
+    tStop = std::chrono::steady_clock::now();
   } //end-Stop
 
   // Returns time in milliseconds
   double ElapsedTime(){
-    // Calculate time difference in milliseconds
-    return ((double)(tStop - tStart)/(double)freq)*1e3;
+    return std::chrono::duration<double, std::milli>(tStop - tStart).count();
   } //end-Elapsed
+
+  // Stops the timer & restarts it from the same instant. Returns the time of the lap in milliseconds
+  double Lap(){
+    Stop();
+    double elapsed = ElapsedTime();
+    tStart = tStop;
+
+    return elapsed;
+  } //end-Lap
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -25,15 +25,96 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <string.h>
+
 #include "Timer.h"
 #include "EdgeMap.h"
 #include "PEL.h"
+#include "ImageIO.h"
+#include "PELPipeline.h"
+#include "PELBatch.h"
+#include "SegmentFile.h"
+#include "ChainCode.h"
+
+static int LinkFrames(FrameSource *source, bool printSegments, bool chainCode);
+static int LinkFramesPipelined(FrameSource *source, bool printSegments, bool chainCode);
+static int LinkBatch(const char *input, const char *outDir, int noThreads, bool saveSegments);
+static int DumpSegmentFile(const char *filename, bool printSegments);
+static int LinkImageRegions(char *filename, char **regionArgs, int noRegions);
 
-/// Two functions to read/save PGM files
-int ReadImagePGM(char *filename, char **pBuffer, int *pWidth, int *pHeight);
-void SaveImagePGM(char *filename, char *buffer, int width, int height);
+///---------------------------------------------------------------------------------
+/// Usage:
+///   PEL [image.pgm|image.pbm]                Link a single image & save the result to PEL-Map.pgm
+/// A binary PBM (P4) image is linked in its bit-packed form with the black pixels as the edgels
+///   PEL -stream [-raw WxH] [file|-] [-segments] [-chain] [-pipeline]  Link a stream of concatenated PGM or raw frames (stdin by default)
+///   PEL -dir <directory> [-segments] [-chain] [-pipeline]         Link the .pgm frames of a directory in name order
+/// In the frame modes, a line is printed per frame. -segments also prints the pixels of the segments.
+/// -pipeline links successive frames in different stages at the same time (see PELPipeline).
+/// -chain also prints the size of the chain coded segments of every frame (see ChainMap)
+///   PEL -batch <directory|list.txt> [-out dir] [-saveseg] [-threads N]   Link a batch of images on a thread pool
+/// The batch mode saves the linked edge maps to <dir>/<name>-PEL.pgm if -out is given (segment files
+/// <dir>/<name>-PEL.seg with -saveseg), and prints a per image timing summary. N defaults to the # of hardware threads
+///   PEL -dump <file.seg> [-segments]         Print a segment file
+///   PEL -roi <image.pgm> x,y,w,h [x,y,w,h ...]  Link the given regions of an image only & save the result to PEL-Map.pgm
+///
+int main(int argc, char **argv){
+  // Batch mode
+  if (argc > 2 && strcmp(argv[1], "-batch") == 0){
+    const char *outDir = NULL;
+    int noThreads = 0;
+    bool saveSegments = false;
+
+    for (int i=3; i<argc; i++){
+      if      (strcmp(argv[i], "-out") == 0 && i+1 < argc) outDir = argv[++i];
+      else if (strcmp(argv[i], "-threads") == 0 && i+1 < argc) noThreads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-saveseg") == 0) saveSegments = true;
+      else {
+        fprintf(stderr, "Usage: %s -batch <directory|list.txt> [-out dir] [-saveseg] [-threads N]\n", argv[0]);
+        return 1;
+      } //end-else
+    } //end-for
+
+    return LinkBatch(argv[2], outDir, noThreads, saveSegments);
+  } //end-if
+
+  // Segment file dump
+  if (argc > 2 && strcmp(argv[1], "-dump") == 0) return DumpSegmentFile(argv[2], argc > 3 && strcmp(argv[3], "-segments") == 0);
+
+  // Regions of an image
+  if (argc > 3 && strcmp(argv[1], "-roi") == 0) return LinkImageRegions(argv[2], argv+3, argc-3);
+
+  // Frame sequence modes
+  if (argc > 1 && (strcmp(argv[1], "-stream") == 0 || strcmp(argv[1], "-dir") == 0)){
+    bool stream = strcmp(argv[1], "-stream") == 0;
+    bool printSegments = false;
+    bool chainCode = false;
+    bool pipeline = false;
+    const char *name = NULL;
+    int rawWidth = 0, rawHeight = 0;
+
+    for (int i=2; i<argc; i++){
+      if (strcmp(argv[i], "-segments") == 0) printSegments = true;
+      else if (strcmp(argv[i], "-chain") == 0) chainCode = true;
+      else if (strcmp(argv[i], "-pipeline") == 0) pipeline = true;
+      else if (strcmp(argv[i], "-raw") == 0 && i+1 < argc){
+        if (sscanf(argv[++i], "%dx%d", &rawWidth, &rawHeight) != 2 || rawWidth <= 0 || rawHeight <= 0){
+          fprintf(stderr, "Invalid raw frame size <%s>. Use WxH\n", argv[i]);
+          return 1;
+        } //end-if
+      } else name = argv[i];
+    } //end-for
+
+    if (!stream && name == NULL){
+      fprintf(stderr, "Usage: %s -dir <directory> [-segments] [-chain] [-pipeline]\n", argv[0]);
+      return 1;
+    } //end-if
+
+    FrameSource source;
+    if (stream ? !source.OpenStream(name, rawWidth, rawHeight) : !source.OpenDirectory(name)) return 1;
+
+    return pipeline ? LinkFramesPipelined(&source, printSegments, chainCode) : LinkFrames(&source, printSegments, chainCode);
+  } //end-if
 
-int main(){
   // Here is the test code
   int width, height;
   unsigned char *bem; 
@@ -59,8 +140,12 @@ int main(){
 //  char *str = (char *)"BEMs/4-Diatom.pgm";
 //  char *str = (char *)"BEMs/5-Diatom.pgm";
 
+  if (argc > 1) str = argv[1];
+
+  int len = (int)strlen(str);
+  bool packed = len > 4 && strcmp(str+len-4, ".pbm") == 0;
 
-  if (ReadImagePGM(str, (char **)&bem, &width, &height) == 0){
+  if ((packed ? ReadImagePBM(str, (char **)&bem, &width, &height) : ReadImagePGM(str, (char **)&bem, &width, &height)) == 0){
     printf("Failed opening <%s>\n", str);
     return 1;
   } //end-if
@@ -72,11 +157,16 @@ int main(){
 
   timer.Start();
 
-  EdgeMap *map = PEL(bem, width, height, 8);
+  PELStats stats;
+  EdgeMap *map = packed ? PELBits(bem, width, height, 8, &stats) : PEL(bem, width, height, 8, &stats);
 
   timer.Stop();
 
-  printf("PEL detects <%d> edge segments in <%4.2lf> ms\n\n", map->noSegments, timer.ElapsedTime());
+  printf("PEL detects <%d> edge segments in <%4.2lf> ms\n", map->noSegments, timer.ElapsedTime());
+  printf("  FillGaps <%4.2lf> Walk <%4.2lf> Clip <%4.2lf> Join <%4.2lf> Thin <%4.2lf> Fix <%4.2lf> ms\n",
+         stats.fillGapsTime, stats.walkTime, stats.clipTime, stats.joinTime, stats.thinTime, stats.fixTime);
+  printf("  <%d> edgels, <%d> gaps filled, <%d> chains walked, <%d> joins\n\n",
+         stats.noEdgels, stats.noGapsFilled, stats.noChains, stats.noJoins);
 
   // This is how you access the pixels of the edge segments returned by ED
   memset(map->edgeImg, 0, width*height);
@@ -91,132 +181,247 @@ int main(){
 
   SaveImagePGM((char *)"PEL-Map.pgm", (char *)map->edgeImg, width, height);
   delete map;
-  delete bem;
+  free(bem);
 
   return 0;
 } //end-main
 
-/******************************************************************************
-* Function: ReadImagePGM
-* Purpose: This function reads in an image in PGM format. The image can be
-* read in from either a file or from standard input. The image is only read
-* from standard input when infilename = NULL. Because the PGM format includes
-* the number of columns and the number of rows in the image, these are read
-* from the file. Memory to store the image is allocated in this function.
-* All comments in the header are discarded in the process of reading the
-* image. Upon failure, this function returns 0, upon sucess it returns 1.
-******************************************************************************/
-int ReadImagePGM(char *filename, char **pBuffer, int *pWidth, int *pHeight){
-   FILE *fp;
-   char buf[71];
-   int width, height;
-
-   if ((fp = fopen(filename, "rb")) == NULL){
-     fprintf(stderr, "Error reading the file %s in ReadImagePGM().\n", filename);
-     return(0);
-   } //end-if
-
-   /***************************************************************************
-   * Verify that the image is in PGM format, read in the number of columns
-   * and rows in the image and scan past all of the header information.
-   ***************************************************************************/
-   fgets(buf, 70, fp);
-   bool P2 = false;
-   bool P5 = false;
-
-   if      (strncmp(buf, "P2", 2) == 0) P2 = true;
-   else if (strncmp(buf, "P5", 2) == 0) P5 = true;
-
-   if (P2 == false && P5 == false){
-      fprintf(stderr, "The file %s is not in PGM format in ", filename);
-      fprintf(stderr, "ReadImagePGM().\n");
-      fclose(fp);
-      return 0;
-   } //end-if
-
-   do {fgets(buf, 70, fp);} while (buf[0] == '#');  /* skip all comment lines */
-   sscanf(buf, "%d %d", &width, &height);
-   fgets(buf, 70, fp);  // Skip max value (255)
-
-   *pWidth = width;
-   *pHeight = height;
-
-   /***************************************************************************
-   * Allocate memory to store the image then read the image from the file.
-   ***************************************************************************/
-   if (((*pBuffer) = (char *) malloc((*pWidth)*(*pHeight))) == NULL){
-      fprintf(stderr, "Memory allocation failure in ReadImagePGM().\n");
-      fclose(fp);
-      return(0);
-   } //end-if  
-
-   if (P2){
-      int index=0;
-      char *p = *pBuffer;
-      int col = 0;
-      int read = 0;
-
-      while (1){
-        int c;
-        if (fscanf(fp, "%d", &c) < 1) break;
-        read++;
-
-        if (col < *pWidth) p[index++] = (unsigned char)c;
-
-        col++;
-        if (col == width) col = 0;
-      } //end-while
-
-      if (read != width*height){
-        fprintf(stderr, "Error reading the image data in ReadImagePGM().\n");
-        fclose(fp);
-        free((*pBuffer));
-        return(0);
-      } //end-if
-
-   } else if (P5){
-      int index=0;
-      char *p = *pBuffer;
-      int col = 0;
-      int read = 0;
-
-      while (1){
-        unsigned char c;
-        if (fread(&c, 1, 1, fp) < 1) break;
-        read++;
-
-        if (col < *pWidth) p[index++] = c;
-
-        col++;
-        if (col == width) col = 0;
-      } //end-while
-
-     if (read != width*height){
-        fprintf(stderr, "Error reading the image data in ReadImagePGM().\n");
-        fclose(fp);
-        free((*pBuffer));
-        return(0);
-     } //end-if
-   } //end-else
-
-   fclose(fp);
-   return 1;
-} //end-ReadPGMImage
+///---------------------------------------------------------------------------------
+/// Print the result of a frame. A negative time is not printed. If "chain" is given,
+/// the frame is chain coded into it & the size of the codes is printed too
+///
+static void PrintFrame(int frameNo, EdgeMap *map, double time, bool printSegments, ChainMap *chain){
+  int noPixels = 0;
+  for (int i=0; i<map->noSegments; i++) noPixels += map->segments[i].noPixels;
+
+  if (time < 0) printf("Frame %d: <%d> edge segments, <%d> pixels\n", frameNo, map->noSegments, noPixels);
+  else          printf("Frame %d: <%d> edge segments, <%d> pixels in <%4.2lf> ms\n", frameNo, map->noSegments, noPixels, time);
+
+  if (chain){
+    chain->Encode(map);
+
+    int size = noPixels*(int)sizeof(Pixel) + map->noSegments*(int)sizeof(EdgeSegment);
+    printf("  Chain coded in <%d> bytes instead of <%d> (%4.1lfx)\n", chain->Size(), size, chain->Size() ? (double)size/chain->Size() : 0.0);
+  } //end-if
+
+  if (printSegments){
+    for (int i=0; i<map->noSegments; i++){
+      printf("  Segment %d <%d>:", i, map->segments[i].noPixels);
+      for (int j=0; j<map->segments[i].noPixels; j++) printf(" %d,%d", map->segments[i].pixels[j].r, map->segments[i].pixels[j].c);
+      printf("\n");
+    } //end-for
+  } //end-if
+
+  fflush(stdout);
+} //end-PrintFrame
+
+///---------------------------------------------------------------------------------
+/// Link the frames of a sequence one by one. All buffers are allocated once for the
+/// first frame & re-used for the rest, so the per frame latency stays flat
+///
+static int LinkFrames(FrameSource *source, bool printSegments, bool chainCode){
+  int width = source->width;
+  int height = source->height;
+
+  unsigned char *frame = new unsigned char[width*height];
+  PELContext ctx(width, height);
+  ChainMap chain;
+  Timer timer;
+
+  double totalTime = 0, maxTime = 0;
+  int status;
+
+  while ((status = source->Next(frame)) == 1){
+    timer.Start();
+
+    EdgeMap *map = ctx.Link(frame, 8);
+
+    timer.Stop();
+
+    double time = timer.ElapsedTime();
+    totalTime += time;
+    if (time > maxTime) maxTime = time;
+
+    PrintFrame(source->noFrames-1, map, time, printSegments, chainCode ? &chain : NULL);
+  } //end-while
+
+  if (status < 0) fprintf(stderr, "Error reading frame %d (or its size is not %dx%d)\n", source->noFrames, width, height);
+
+  if (source->noFrames > 0)
+    printf("%d frames of %dx%d: <%4.2lf> ms per frame on average, <%4.2lf> ms max\n", source->noFrames, width, height, totalTime/source->noFrames, maxTime);
+
+  delete[] frame;
+
+  return status < 0 ? 1 : 0;
+} //end-LinkFrames
+
+// Arguments of the pipeline's read & write functions
+struct FrameArgs {
+  FrameSource *source;
+  int status;           // Status of the last read
+  bool printSegments;
+  ChainMap *chain;      // Chain code the frames into this if not NULL
+};
+
+static bool ReadFrame(unsigned char *edgeImg, void *arg){
+  FrameArgs *args = (FrameArgs *)arg;
+
+  args->status = args->source->Next(edgeImg);
+  return args->status == 1;
+} //end-ReadFrame
+
+static void WriteFrame(int frameNo, EdgeMap *map, void *arg){
+  FrameArgs *args = (FrameArgs *)arg;
+
+  PrintFrame(frameNo, map, -1, args->printSegments, args->chain);
+} //end-WriteFrame
+
+///---------------------------------------------------------------------------------
+/// Link the frames of a sequence in a pipeline. Per frame times overlap, so the throughput is reported
+///
+static int LinkFramesPipelined(FrameSource *source, bool printSegments, bool chainCode){
+  PELPipeline pipeline(source->width, source->height, 4, 8);
+
+  FrameArgs args;
+  args.source = source;
+  args.status = 0;
+  args.printSegments = printSegments;
+
+  ChainMap chain;
+  args.chain = chainCode ? &chain : NULL;
+
+  Timer timer;
+  timer.Start();
+
+  int noFrames = pipeline.Run(ReadFrame, WriteFrame, &args);
+
+  timer.Stop();
+
+  if (args.status < 0) fprintf(stderr, "Error reading frame %d (or its size is not %dx%d)\n", source->noFrames, source->width, source->height);
+
+  if (noFrames > 0)
+    printf("%d frames of %dx%d: <%4.2lf> ms per frame on average (pipelined)\n", noFrames, source->width, source->height, timer.ElapsedTime()/noFrames);
+
+  return args.status < 0 ? 1 : 0;
+} //end-LinkFramesPipelined
 
 ///---------------------------------------------------------------------------------
-/// Save a buffer as a .pgm image
+/// Link a batch of images & print a per image timing summary in the input order
 ///
-void SaveImagePGM(char *filename, char *buffer, int width, int height){
-  FILE *fp = fopen(filename, "wb");
+static int LinkBatch(const char *input, const char *outDir, int noThreads, bool saveSegments){
+  char **files;
+  int noFiles = ListInputFiles(input, &files);
+  if (noFiles <= 0){
+    if (noFiles == 0) fprintf(stderr, "No input images in <%s>\n", input);
+    return 1;
+  } //end-if
+
+  PELBatch batch(noThreads, 8, outDir);
+  batch.saveSegments = saveSegments;
+  BatchResult *results = new BatchResult[noFiles];
+
+  Timer timer;
+  timer.Start();
 
-  // .PGM header
-  fprintf(fp, "P5\n");
-  fprintf(fp, "# Some comment here!\n");
-  fprintf(fp, "%d %d\n", width, height);
-  fprintf(fp, "255\n");
+  int noFailed = batch.Run(files, noFiles, results);
+
+  timer.Stop();
+
+  double readTime = 0, linkTime = 0, saveTime = 0;
+  for (int i=0; i<noFiles; i++){
+    BatchResult *r = &results[i];
+
+    if (r->failed){
+      printf("%s: FAILED\n", files[i]);
+      continue;
+    } //end-if
+
+    printf("%s: %dx%d, <%d> edge segments, <%d> pixels, read <%4.2lf> link <%4.2lf> save <%4.2lf> ms (worker %d)\n",
+           files[i], r->width, r->height, r->noSegments, r->noPixels, r->readTime, r->linkTime, r->saveTime, r->worker);
+
+    readTime += r->readTime;
+    linkTime += r->linkTime;
+    saveTime += r->saveTime;
+  } //end-for
+
+  int noLinked = noFiles - noFailed;
+  printf("%d images (%d failed) on %d threads in <%4.2lf> ms: read <%4.2lf> link <%4.2lf> save <%4.2lf> ms per image\n",
+         noFiles, noFailed, batch.noThreads, timer.ElapsedTime(),
+         noLinked ? readTime/noLinked : 0, noLinked ? linkTime/noLinked : 0, noLinked ? saveTime/noLinked : 0);
+
+  delete[] results;
+  FreeFileList(files, noFiles);
+
+  return noFailed ? 1 : 0;
+} //end-LinkBatch
+
+///---------------------------------------------------------------------------------
+/// Print the segments of a segment file as the frame modes do
+///
+static int DumpSegmentFile(const char *filename, bool printSegments){
+  SegmentFile file;
+  if (!file.Open(filename)) return 1;
 
-  // Grayscale image
-  fwrite(buffer, 1, width*height, fp);
+  printf("%s: %dx%d, <%d> edge segments, <%d> pixels\n", filename, file.width, file.height, file.noSegments, file.noPixels);
 
-  fclose( fp );
-} //end-SaveImagePGM
\ No newline at end of file
+  if (printSegments){
+    for (int i=0; i<file.noSegments; i++){
+      const Pixel *pixels = file.SegmentPixels(i);
+
+      printf("  Segment %d <%d>:", i, file.SegmentLength(i));
+      for (int j=0; j<file.SegmentLength(i); j++) printf(" %d,%d", pixels[j].r, pixels[j].c);
+      printf("\n");
+    } //end-for
+  } //end-if
+
+  return 0;
+} //end-DumpSegmentFile
+
+///---------------------------------------------------------------------------------
+/// Link the regions of an image given as x,y,w,h in place & save the result to PEL-Map.pgm
+///
+static int LinkImageRegions(char *filename, char **regionArgs, int noRegions){
+  PELRect *regions = new PELRect[noRegions];
+  for (int i=0; i<noRegions; i++){
+    if (sscanf(regionArgs[i], "%d,%d,%d,%d", &regions[i].x, &regions[i].y, &regions[i].width, &regions[i].height) != 4){
+      fprintf(stderr, "Invalid region <%s>. Use x,y,w,h\n", regionArgs[i]);
+      delete[] regions;
+      return 1;
+    } //end-if
+  } //end-for
+
+  int width, height;
+  unsigned char *bem;
+  if (ReadImagePGM(filename, (char **)&bem, &width, &height) == 0){
+    printf("Failed opening <%s>\n", filename);
+    delete[] regions;
+    return 1;
+  } //end-if
+
+  PELContext ctx(width, height);
+  Timer timer;
+
+  timer.Start();
+  EdgeMap *map = ctx.LinkRegions(bem, width, height, width, regions, noRegions, 8);
+  timer.Stop();
+
+  // The regions are clipped to the image as LinkRegions does
+  int area = 0;
+  for (int i=0; i<noRegions; i++){
+    int x0 = regions[i].x < 0 ? 0 : regions[i].x;
+    int y0 = regions[i].y < 0 ? 0 : regions[i].y;
+    int x1 = regions[i].x + regions[i].width < width ? regions[i].x + regions[i].width : width;
+    int y1 = regions[i].y + regions[i].height < height ? regions[i].y + regions[i].height : height;
+    if (x1 > x0 && y1 > y0) area += (x1-x0)*(y1-y0);
+  } //end-for
+
+  printf("PEL detects <%d> edge segments in %d regions (%4.1lf%% of the %dx%d image) in <%4.2lf> ms\n",
+         map->noSegments, noRegions, 100.0*area/(width*height), width, height, timer.ElapsedTime());
+
+  map->ConvertEdgeSegments2EdgeImg();
+  SaveImagePGM((char *)"PEL-Map.pgm", (char *)map->edgeImg, width, height);
+
+  free(bem);
+  delete[] regions;
+  return 0;
+} //end-LinkImageRegions
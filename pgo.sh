@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Profile-guided build of PEL (GCC or Clang)
+#
+#   ./pgo.sh [build-dir] [training images: directory|list.txt ...]
+#
+# 1. Builds the instrumented binaries in <build-dir>/pgo
+# 2. Trains them on synthetic edge maps of every kind (pelbench) & on the given images (pel -batch)
+# 3. Rebuilds <build-dir>/pgo with the profile. The profile is matched by the object paths,
+#    so both builds share the build directory
+# 4. Builds the plain release in <build-dir>/release & compares the two on pelbench
+#
+# Set CC/CXX to choose the compiler and CMAKE_ARGS for more configure options, e.g., -DPEL_NATIVE=ON
+#
+set -e
+
+SRC=$(cd "$(dirname "$0")" && pwd)
+BUILD=${1:-_pgo_build}
+[ $# -gt 0 ] && shift
+mkdir -p "$BUILD"
+BUILD=$(cd "$BUILD" && pwd)
+
+PROFILE=$BUILD/profile
+JOBS=$(nproc 2>/dev/null || echo 2)
+
+# Training & benchmark maps differ in size, so the comparison is not on the training data
+TRAIN_SIZES=${TRAIN_SIZES:-640x480,1280x720,1920x1080}
+BENCH_SIZES=${BENCH_SIZES:-512x512,1024x1024,3840x2160}
+BENCH_REPS=${BENCH_REPS:-5}
+
+echo "== Building the instrumented binaries"
+rm -rf "$PROFILE"
+cmake -S "$SRC" -B "$BUILD/pgo" -DCMAKE_BUILD_TYPE=Release -DPEL_PGO=GENERATE -DPEL_PGO_DIR="$PROFILE" $CMAKE_ARGS > /dev/null
+cmake --build "$BUILD/pgo" -j "$JOBS" --clean-first
+
+echo "== Training"
+"$BUILD/pgo/pelbench" -sizes "$TRAIN_SIZES" -reps 3 -warmup 0 > /dev/null
+for input in "$@"; do
+  mkdir -p "$BUILD/train-out"
+  "$BUILD/pgo/pel" -batch "$input" -out "$BUILD/train-out" > /dev/null
+done
+
+if ls "$PROFILE"/*.profraw > /dev/null 2>&1; then
+  PROFDATA=$(command -v llvm-profdata || xcrun -f llvm-profdata)
+  "$PROFDATA" merge -output="$PROFILE/default.profdata" "$PROFILE"/*.profraw
+fi
+
+echo "== Building with the profile"
+cmake -S "$SRC" -B "$BUILD/pgo" -DPEL_PGO=USE > /dev/null
+cmake --build "$BUILD/pgo" -j "$JOBS" --clean-first
+
+echo "== Building the plain release"
+cmake -S "$SRC" -B "$BUILD/release" -DCMAKE_BUILD_TYPE=Release -DPEL_PGO=OFF $CMAKE_ARGS > /dev/null
+cmake --build "$BUILD/release" -j "$JOBS"
+
+echo "== Comparing on pelbench -sizes $BENCH_SIZES"
+"$BUILD/release/pelbench" -sizes "$BENCH_SIZES" -reps "$BENCH_REPS" -csv > "$BUILD/release.csv"
+"$BUILD/pgo/pelbench" -sizes "$BENCH_SIZES" -reps "$BENCH_REPS" -csv > "$BUILD/pgo.csv"
+
+# Both runs link the same maps in the same order: Compare the min times line by line
+paste -d, "$BUILD/release.csv" "$BUILD/pgo.csv" | awk -F, '
+  NR == 1 {printf("%-8s %11s %12s %12s %8s\n", "kind", "size", "release ms", "pgo ms", "speedup"); next}
+  {
+    n = NF/2; speedup = $7/$(n+7)
+    printf("%-8s %11s %12.2f %12.2f %7.2fx\n", $1, $2 "x" $3, $7, $(n+7), speedup)
+    logSum += log(speedup); count++
+  }
+  END {if (count) printf("Geometric mean speedup: %.3fx\n", exp(logSum/count))}'